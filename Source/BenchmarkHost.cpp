@@ -0,0 +1,387 @@
+// Headless benchmark host. Builds N processors and calls their processBlock
+// round-robin, the way a host with N instances in a session would, so we can see
+// how the per-sample cost holds up once the combined working set no longer fits
+// in the caches. Built only with RANDOMEQ_BUILD_BENCHMARKS (see CMakeLists.txt)
+//
+// usage: RandomEQBenchmark [--instances=1,4,16] [--blocks=16,64,256,1024]
+//                          [--rate=48000] [--seconds=1] [--budget=0.2] [--startup]
+//                          [--oversampling]
+//
+// --budget sets each instance's CPU budget (see QualityScheduler), and the tier
+// column shows the lowest quality tier any instance ended up on. --startup times
+// opening a session instead: creating, preparing and opening editors on N instances.
+// --oversampling turns oversampling on (the plugin starts with it off), and the
+// factors column counts the instances running at 1x, 2x and 4x (see Oversampler)
+
+#include "PluginProcessor.h"
+#include "RealtimeCheck.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#if defined(__linux__)
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+ #include <malloc.h>
+#elif defined(__APPLE__)
+ #include <malloc/malloc.h>
+#endif
+
+namespace {
+
+// a hardware cache-miss counter for the calling thread. only Linux exposes these
+// without special entitlements, everywhere else the counter is just unavailable
+class MissCounter {
+ public:
+    enum Kind {
+        L1DataRead,
+        // reads that got past L2 and looked in the last level. the kernel has no generic
+        // L2 event, but on the usual three-level parts these are the L2 read misses
+        L2Read,
+        LastLevel
+    };
+
+    explicit MissCounter(const Kind& kind) {
+       #if defined(__linux__)
+        perf_event_attr attr {};
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        if(kind == L1DataRead) {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        else if(kind == L2Read) {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL
+                        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+        }
+        else {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+       #else
+        juce::ignoreUnused(kind);
+       #endif
+    }
+
+    ~MissCounter() {
+       #if defined(__linux__)
+        if(fd >= 0)
+            close(fd);
+       #endif
+    }
+
+    bool IsAvailable() const { return fd >= 0; }
+
+    void Start() {
+       #if defined(__linux__)
+        if(fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+       #endif
+    }
+
+    long long Stop() {
+        long long count = 0;
+
+       #if defined(__linux__)
+        if(fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if(read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count))
+                count = 0;
+        }
+       #endif
+
+        return count;
+    }
+
+ private:
+    int fd = -1;
+};
+
+// bytes currently allocated from the heap, or 0 if the platform can't say
+size_t GetHeapBytes() {
+   #if defined(__GLIBC__)
+    // large blocks are mmapped separately, and don't show up in uordblks
+    #if __GLIBC_PREREQ(2, 33)
+     const auto info = mallinfo2();
+     return info.uordblks + info.hblkhd;
+    #else
+     const auto info = mallinfo();
+     return (size_t)(unsigned)info.uordblks + (size_t)(unsigned)info.hblkhd;
+    #endif
+   #elif defined(__APPLE__)
+    return mstats().bytes_used;
+   #else
+    return 0;
+   #endif
+}
+
+std::vector<int> ParseList(const juce::String& text, const std::vector<int>& fallback) {
+    if(text.isEmpty())
+        return fallback;
+
+    std::vector<int> values;
+    for(auto& item : juce::StringArray::fromTokens(text, ",", ""))
+        if(item.getIntValue() > 0)
+            values.push_back(item.getIntValue());
+
+    return values.empty() ? fallback : values;
+}
+
+struct Result {
+    double nsPerSample = 0.0;
+    double load = 0.0;
+    double l1Misses = -1.0, l2Misses = -1.0, llcMisses = -1.0;
+};
+
+// runs `rounds` blocks through every instance in turn. each block is refilled from
+// the shared input first, since processing is in place
+template<class Body>
+Result Run(const int& rounds, const int& numInstances, const int& blockSize,
+           const int& sampleRate, Body&& body) {
+    MissCounter l1 { MissCounter::L1DataRead }, l2 { MissCounter::L2Read },
+                llc { MissCounter::LastLevel };
+
+    l1.Start();
+    l2.Start();
+    llc.Start();
+    const auto tStart = std::chrono::steady_clock::now();
+
+    for(int round = 0; round < rounds; ++round)
+        for(int i = 0; i < numInstances; ++i)
+            body(round, i);
+
+    const auto tEnd = std::chrono::steady_clock::now();
+    const long long l1Count = l1.Stop(), l2Count = l2.Stop(), llcCount = llc.Stop();
+
+    const double ns = std::chrono::duration<double, std::nano>(tEnd - tStart).count();
+    const double samples = (double)rounds * numInstances * blockSize;
+
+    Result result;
+    result.nsPerSample = ns / samples;
+    result.load = ns * 1e-9 / ((double)rounds * blockSize / sampleRate);
+    if(l1.IsAvailable())
+        result.l1Misses = (double)l1Count / samples;
+    if(l2.IsAvailable())
+        result.l2Misses = (double)l2Count / samples;
+    if(llc.IsAvailable())
+        result.llcMisses = (double)llcCount / samples;
+
+    return result;
+}
+
+// negative values mean the figure isn't available on this platform
+void PrintOptional(const double& value, const int& width, const int& precision) {
+    if(value < 0.0)
+        std::printf(" %*s", width, "n/a");
+    else
+        std::printf(" %*.*f", width, precision, value);
+}
+
+// times what a host does when it opens a session: create every instance, prepare
+// them all, then open an editor on each
+void RunStartupBenchmark(const std::vector<int>& instanceCounts, const int& sampleRate,
+                         const int& blockSize) {
+    using Clock = std::chrono::steady_clock;
+
+    std::printf("%9s %12s %12s %12s %14s %14s\n", "instances", "create us", "prepare us",
+                "editor us", "heap/inst", "editor/inst");
+
+    for(const int numInstances : instanceCounts) {
+        std::vector<std::unique_ptr<RandomEQProcessor>> processors;
+        std::vector<std::unique_ptr<juce::AudioProcessorEditor>> editors;
+        processors.reserve((size_t)numInstances);
+        editors.reserve((size_t)numInstances);
+
+        const size_t heapStart = GetHeapBytes();
+        const auto tStart = Clock::now();
+
+        for(int i = 0; i < numInstances; ++i)
+            processors.push_back(std::make_unique<RandomEQProcessor>());
+
+        const auto tCreated = Clock::now();
+
+        for(auto& processor : processors)
+            processor->prepareToPlay(sampleRate, blockSize);
+
+        const auto tPrepared = Clock::now();
+        const size_t heapPrepared = GetHeapBytes();
+
+        for(auto& processor : processors)
+            editors.emplace_back(processor->createEditorIfNeeded());
+
+        const auto tEditors = Clock::now();
+        const size_t heapEditors = GetHeapBytes();
+
+        // editors have to go before their processors
+        editors.clear();
+
+        auto perInstanceUs = [&](const Clock::time_point& from, const Clock::time_point& to) {
+            return std::chrono::duration<double, std::micro>(to - from).count() / numInstances;
+        };
+        auto perInstanceBytes = [&](const size_t& from, const size_t& to) {
+            return to > from ? (double)(to - from) / numInstances : -1.0;
+        };
+
+        std::printf("%9d %12.1f %12.1f %12.1f", numInstances, perInstanceUs(tStart, tCreated),
+                    perInstanceUs(tCreated, tPrepared), perInstanceUs(tPrepared, tEditors));
+        PrintOptional(perInstanceBytes(heapStart, heapPrepared), 14, 0);
+        PrintOptional(perInstanceBytes(heapPrepared, heapEditors), 14, 0);
+        std::printf("\n");
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    const auto instanceCounts = ParseList(args.getValueForOption("--instances"),
+                                          { 1, 4, 16, 64, 256, 1024 });
+    const auto blockSizes = ParseList(args.getValueForOption("--blocks"),
+                                      { 16, 64, 256, 1024 });
+    const int sampleRate = juce::jmax(8000, args.getValueForOption("--rate").getIntValue() > 0
+                                      ? args.getValueForOption("--rate").getIntValue() : 48000);
+    const double seconds = args.containsOption("--seconds")
+                         ? juce::jmax(0.01, args.getValueForOption("--seconds").getDoubleValue()) : 1.0;
+
+    const float budget = args.containsOption("--budget")
+                       ? (float)args.getValueForOption("--budget").getDoubleValue()
+                       : QualityScheduler::defaultBudget;
+
+    const bool oversampling = args.containsOption("--oversampling");
+
+    const int maxBlockSize = *std::max_element(blockSizes.begin(), blockSizes.end());
+    constexpr int numChannels = 2;
+
+    // one second of program-like noise, shared by every instance as its input
+    std::vector<float> input((size_t)(sampleRate + maxBlockSize));
+    {
+        SignalGenerator generator;
+        generator.SetSampleRate(sampleRate);
+        generator.Generate(SignalGenerator::Program, input.data(), (int)input.size());
+    }
+
+    if(args.containsOption("--startup")) {
+        std::printf("RandomEQ startup benchmark, %d Hz, %d sample blocks\n\n", sampleRate, maxBlockSize);
+        RunStartupBenchmark(instanceCounts, sampleRate, maxBlockSize);
+        return 0;
+    }
+
+    // the latency is for the highest band any exercise can use, but each instance runs
+    // at whatever its own band needs
+    const int latency = oversampling
+        ? Oversampler::GetLatency(Oversampler::ChooseFactor(RandomParameters::GetHighestFrequency(),
+                                                            sampleRate)) : 0;
+
+    std::printf("RandomEQ benchmark, %d Hz, %.2f s of audio per run, oversampling %s (%d samples latency)\n",
+                sampleRate, seconds, oversampling ? "on" : "off, as the plugin starts", latency);
+    std::printf("sizeof(RandomEQProcessor) = %zu bytes, hot filter state = %zu bytes per channel\n\n",
+                sizeof(RandomEQProcessor), sizeof(DualFilter));
+    std::printf("%9s %6s %12s %10s %10s %10s %10s %10s %5s %14s\n",
+                "instances", "block", "heap/inst", "ns/sample", "load", "L1D/smp", "L2/smp", "LLC/smp", "tier",
+                "1x/2x/4x");
+
+    for(const int numInstances : instanceCounts) {
+        const size_t heapBefore = GetHeapBytes();
+
+        std::vector<std::unique_ptr<RandomEQProcessor>> processors;
+        std::vector<juce::AudioBuffer<float>> buffers;
+        processors.reserve((size_t)numInstances);
+        buffers.reserve((size_t)numInstances);
+
+        for(int i = 0; i < numInstances; ++i) {
+            auto processor = std::make_unique<RandomEQProcessor>();
+            processor->SetOversampling(oversampling);
+            processor->prepareToPlay(sampleRate, maxBlockSize);
+            processor->SetCpuBudget(budget);
+
+            // spread the bands out, so neighbouring instances run different coefficients
+            const double freq = 100.0 * std::pow(100.0, (double)(i % 64) / 64.0);
+            processor->SetBand(DualFilter::Hidden, (FilterType)(LowShelf + i % 3), freq, 0.707,
+                               i % 2 == 0 ? 6.0 : -6.0);
+
+            processors.push_back(std::move(processor));
+            buffers.emplace_back(numChannels, maxBlockSize);
+        }
+
+        const size_t heapAfter = GetHeapBytes();
+        const double heapPerInstance = heapAfter > heapBefore
+                                     ? (double)(heapAfter - heapBefore) / numInstances : -1.0;
+
+        juce::MidiBuffer midi;
+
+        for(const int blockSize : blockSizes) {
+            const int inputBlocks = sampleRate / blockSize;
+            // keep the total work roughly constant, but always run at least a few rounds
+            const int rounds = juce::jmax(4, (int)(seconds * sampleRate / blockSize / numInstances));
+
+            auto refill = [&](const int& round, const int& i) {
+                const float* source = input.data() + (size_t)((round % inputBlocks) * blockSize);
+                buffers[(size_t)i].setSize(numChannels, blockSize, false, false, true);
+                for(int ch = 0; ch < numChannels; ++ch)
+                    buffers[(size_t)i].copyFrom(ch, 0, source, blockSize);
+            };
+
+            // warm up (and let the queued bands apply), then time the refill on its
+            // own so it can be taken back out of the processing figures
+            for(int i = 0; i < numInstances; ++i) {
+                refill(0, i);
+                processors[(size_t)i]->processBlock(buffers[(size_t)i], midi);
+            }
+
+            const Result copyOnly = Run(rounds, numInstances, blockSize, sampleRate, refill);
+            const Result total = Run(rounds, numInstances, blockSize, sampleRate,
+                                     [&](const int& round, const int& i) {
+                refill(round, i);
+                processors[(size_t)i]->processBlock(buffers[(size_t)i], midi);
+            });
+
+            std::printf("%9d %6d", numInstances, blockSize);
+            PrintOptional(heapPerInstance, 12, 0);
+            std::printf(" %10.2f %9.1f%%", total.nsPerSample - copyOnly.nsPerSample,
+                        (total.load - copyOnly.load) * 100.0);
+            PrintOptional(total.l1Misses < 0.0 ? -1.0 : juce::jmax(0.0, total.l1Misses - copyOnly.l1Misses), 10, 4);
+            PrintOptional(total.l2Misses < 0.0 ? -1.0 : juce::jmax(0.0, total.l2Misses - copyOnly.l2Misses), 10, 4);
+            PrintOptional(total.llcMisses < 0.0 ? -1.0 : juce::jmax(0.0, total.llcMisses - copyOnly.llcMisses), 10, 4);
+
+            // the factors as they were at the end, after any tier change
+            int lowestTier = QualityScheduler::Full, factors[Oversampler::numFactors] {};
+
+            for(const auto& processor : processors) {
+                lowestTier = juce::jmax(lowestTier, (int)processor->GetQualityTier());
+                ++factors[Oversampler::GetFactorIndex(processor->GetRunningFactor())];
+            }
+
+            char factorCounts[32];
+            std::snprintf(factorCounts, sizeof(factorCounts), "%d/%d/%d", factors[0], factors[1], factors[2]);
+            std::printf(" %5d %14s\n", lowestTier, factorCounts);
+        }
+    }
+
+    std::printf("\nns/sample is per instance and per sample frame (all channels), load is the\n"
+                "share of one core needed to keep every instance running in real time.\n"
+                "cache misses are per sample frame (L2 counts reads that reached the last\n"
+                "level); n/a where the platform has no counters\n");
+
+   #if RANDOMEQ_RT_CHECK
+    std::printf("audio thread violations: %d\n", RealtimeCheck::GetViolationCount());
+   #endif
+
+    return 0;
+}
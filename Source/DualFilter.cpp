@@ -0,0 +1,112 @@
+// Implementation of the dual-lane biquad used for A/B comparisons
+
+#include "DualFilter.h"
+#include "LoudnessMeter.h"
+
+DualFilter::DualFilter() {
+    // both lanes start as a pass-through
+    for(int lane = 0; lane < NumLanes; ++lane)
+        a0[lane] = 1.0;
+}
+
+void DualFilter::SetSampleRate(const int& sampleRate) {
+    // a linear ramp over the crossfade time, but never slower than one sample
+    const double fadeSamples = crossfadeTimeMs * 0.001 * sampleRate;
+    mMixStep = fadeSamples > 1.0 ? 1.0 / fadeSamples : 1.0;
+}
+
+DualFilter::BandDesign DualFilter::Design(const FilterType& type, const double& freq,
+                                          const double& q, const double& gain,
+                                          const int& sampleRate, const bool& withMakeup) {
+    BandDesign band;
+    band.type = type;
+    band.freq = freq;
+    band.q = q;
+    band.gain = gain;
+
+    if(sampleRate <= 0)
+        return band;
+
+    band.sampleRate = sampleRate;
+    band.factor = Oversampler::ChooseFactor(freq, sampleRate);
+    band.hasMakeup = withMakeup;
+
+    for(const int factor : { 1, 2, 4 }) {
+        const int index = Oversampler::GetFactorIndex(factor),
+                  rate = sampleRate * factor;
+
+        Filter design;
+        design.useFastProcessing = false;
+        design.SetSampleRate(rate);
+        design.SetParameters(type, freq, q, gain);
+
+        band.coefficients[index] = design.GetCoefficients();
+        band.prewarp[index] = tan(M_PI * (freq / rate));
+
+        if(withMakeup)
+            band.makeupGain[index] = LoudnessMeter::GetStaticMakeupGain(design, rate);
+    }
+
+    return band;
+}
+
+BiquadCoefficients DualFilter::BandDesign::GetCoefficients(const int& osFactor,
+                                                           const bool& withMakeup) const {
+    const int index = Oversampler::GetFactorIndex(osFactor);
+    BiquadCoefficients c = coefficients[index];
+
+    // folded into the feedforward coefficients, so it costs nothing per sample
+    if(withMakeup) {
+        c.a0 *= makeupGain[index];
+        c.a1 *= makeupGain[index];
+        c.a2 *= makeupGain[index];
+    }
+
+    return c;
+}
+
+void DualFilter::SetLaneCoefficients(const Lane& lane, const BiquadCoefficients& c) {
+    a0[lane] = c.a0;
+    a1[lane] = c.a1;
+    a2[lane] = c.a2;
+    b1[lane] = c.b1;
+    b2[lane] = c.b2;
+}
+
+void DualFilter::Reset() {
+    for(int lane = 0; lane < NumLanes; ++lane) {
+        z1[lane] = 0.0;
+        z2[lane] = 0.0;
+    }
+}
+
+void DualFilter::SetActiveLane(const Lane& lane) {
+    mMixTarget = lane == Guess ? 1.0 : 0.0;
+}
+
+DualFilter::Lane DualFilter::GetActiveLane() const {
+    return mMixTarget > 0.5 ? Guess : Hidden;
+}
+
+float DualFilter::Process(const float& in) {
+    if(!mEnabled)
+        return in;
+
+    const double x = in;
+    double out[NumLanes];
+
+    // both chains share the input, so this loop is a straight two-wide operation
+    for(int lane = 0; lane < NumLanes; ++lane) {
+        out[lane] = x * a0[lane] + z1[lane];
+        z1[lane] = x * a1[lane] + z2[lane] - b1[lane] * out[lane];
+        z2[lane] = x * a2[lane] - b2[lane] * out[lane];
+    }
+
+    // sample-accurate crossfade between the lanes
+    if(mMix < mMixTarget)
+        mMix = mMix + mMixStep > mMixTarget ? mMixTarget : mMix + mMixStep;
+    else if(mMix > mMixTarget)
+        mMix = mMix - mMixStep < mMixTarget ? mMixTarget : mMix - mMixStep;
+
+    return (float)(out[Hidden] + mMix * (out[Guess] - out[Hidden]));
+}
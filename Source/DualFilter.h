@@ -0,0 +1,100 @@
+// Declaration of a dual-lane biquad, used to A/B the hidden EQ band against the
+// band the user guessed. Both chains run on every sample, packed side-by-side so
+// each step is a single two-wide (SSE2/NEON) operation, and switching between
+// them is a short crossfade rather than a coefficient change or state reset.
+// The lanes keep double state and coefficients with float in/out, like
+// Filter::Process(float) — a float-state version measured both slower and far
+// noisier for the low bands at high sample rates.
+//
+// Nothing here designs a band: bands are designed on the message thread (see
+// Design()), and the audio thread only ever copies coefficients into a lane.
+
+#pragma once
+#include "Filter.h"
+#include "Oversampler.h"
+
+class DualFilter {
+ public:
+    enum Lane {
+        Hidden = 0,
+        Guess,
+        NumLanes
+    };
+
+    // a band worked out ahead of time (off the audio thread), ready to load into a
+    // lane. it's designed at every oversampling factor, so changing the factor never
+    // needs a new design either
+    struct BandDesign {
+        FilterType type = Peak;
+        double freq = 1000.0, q = 0.707, gain = 0.0;
+
+        // the host's rate it was designed for, 0 if it hasn't been (and passes through)
+        int sampleRate {};
+
+        // the lowest oversampling factor that keeps the band in shape at that rate (see
+        // Oversampler::ChooseFactor())
+        int factor = 1;
+
+        // everything below is per factor (see Oversampler::GetFactorIndex())
+        BiquadCoefficients coefficients[Oversampler::numFactors];
+
+        // see LoudnessMeter::GetStaticMakeupGain(). only worked out when it was asked
+        // for (it's left at 1 otherwise), since only the static match mode uses it
+        double makeupGain[Oversampler::numFactors] { 1.0, 1.0, 1.0 };
+        bool hasMakeup = false;
+
+        // tan(pi * freq / rate), which is all DynamicBand needs to work out the rest
+        double prewarp[Oversampler::numFactors] {};
+
+        // the coefficients for the given factor, scaled by the makeup gain if asked
+        BiquadCoefficients GetCoefficients(const int& osFactor, const bool& withMakeup) const;
+    };
+
+ private:
+    // structure-of-arrays, so the compiler can pack both lanes into one register.
+    // the lanes, their state and the crossfade are all Process() touches (136 bytes,
+    // so three cache lines at most), so they lead the object. aligned to 16 so each
+    // pair of lanes loads whole and never straddles a line; that costs nothing, as the
+    // object is 144 bytes either way. aligning to a line padded it to 192 bytes, and
+    // BenchmarkHost showed no difference (2048 instances, 64 sample blocks)
+    alignas(16) double a0[NumLanes] {};
+    double a1[NumLanes] {}, a2[NumLanes] {},
+           b1[NumLanes] {}, b2[NumLanes] {},
+           z1[NumLanes] {}, z2[NumLanes] {};
+
+    // 0 = hidden lane only, 1 = guess lane only
+    double mMix {}, mMixTarget {}, mMixStep {};
+
+ public:
+    // used to bypass the filter processing (saves performance too)
+    bool mEnabled = true;
+
+    DualFilter();
+
+    // the rate Process() is called at, which is a multiple of the host's when
+    // oversampling. only sets the crossfade's length, the lanes keep their coefficients
+    void SetSampleRate(const int& sampleRate);
+
+    // works out everything a lane needs for a band at the given host rate, with the
+    // precise coefficients. slow (tan(), pow(), and the makeup gain's response for each
+    // factor if asked for), but doesn't touch any filter, so it's for the message thread
+    // or a worker
+    static BandDesign Design(const FilterType& type, const double& freq, const double& q,
+                             const double& gain, const int& sampleRate,
+                             const bool& withMakeup);
+
+    // sets a lane from coefficients worked out elsewhere. a straight copy, so this is
+    // how the audio thread changes a band
+    void SetLaneCoefficients(const Lane& lane, const BiquadCoefficients& c);
+
+    // clears both lanes' state, but not their coefficients or the crossfade
+    void Reset();
+
+    // starts a crossfade towards the given lane — both lanes keep running
+    void SetActiveLane(const Lane& lane);
+    Lane GetActiveLane() const;
+
+    float Process(const float&);
+
+    static constexpr double crossfadeTimeMs = 10.0;
+};
@@ -0,0 +1,155 @@
+// Implementation of the envelope-driven dynamic EQ band
+
+#include "DynamicBand.h"
+
+DynamicBand::DynamicBand() {
+    Reset();
+}
+
+void DynamicBand::SetSampleRate(const int& sampleRate) {
+    this->mSampleRate = sampleRate;
+
+    mAttack = (float)exp(-1.0 / (attackMs * 0.001 * sampleRate));
+    mRelease = (float)exp(-1.0 / (releaseMs * 0.001 * sampleRate));
+}
+
+void DynamicBand::SetParameters(const FilterType& type, const double& prewarp,
+                                const double& q, const double& gain, const double& makeupGain) {
+    this->mType = type;
+    this->mGainDb = gain;
+    this->mMakeupDb = 20.0 * log10(makeupGain);
+
+    // the same terms as Filter::SetCoefficients(), minus anything that depends on gain
+    k = prewarp;
+    k2 = k * k;
+    kOverQ = k / q;
+    sqrt2K = sqrt(2.0) * k;
+
+    mChanged = true;
+}
+
+void DynamicBand::Reset() {
+    mEnvelope = 0.0f;
+    mCurrentGainDb = 0.0;
+    mChanged = true;
+}
+
+const BiquadCoefficients& DynamicBand::Process(const float* const* channels, const int& numChannels,
+                                               const int& startSample, const int& numSamples) {
+    float envelope = mEnvelope;
+
+    for(int sample = startSample; sample < startSample + numSamples; ++sample) {
+        float peak = 0.0f;
+
+        for(int channel = 0; channel < numChannels; ++channel) {
+            const float level = fabsf(channels[channel][sample]);
+            peak = level > peak ? level : peak;
+        }
+
+        const float coef = peak > envelope ? mAttack : mRelease;
+        envelope = peak + coef * (envelope - peak);
+    }
+
+    mEnvelope = envelope;
+
+    // how far into the knee the envelope is, 0 (below threshold) to 1
+    const double levelDb = envelope > 1e-6f ? 20.0 * log10((double)envelope) : -120.0;
+    double amount = (levelDb - mThresholdDb) / mKneeDb;
+    amount = amount < 0.0 ? 0.0 : (amount > 1.0 ? 1.0 : amount);
+
+    const double gainDb = mGainDb * amount;
+
+    if(mChanged || fabs(gainDb - mCurrentGainDb) >= gainResolutionDb)
+        UpdateCoefficients(gainDb);
+
+    return mCoefficients;
+}
+
+void DynamicBand::UpdateCoefficients(const double& gainDb) {
+    mCurrentGainDb = gainDb;
+    mChanged = false;
+
+    const double v = pow(10.0, fabs(gainDb) * 0.05);
+    double norm = 0.0;
+    BiquadCoefficients& c = mCoefficients;
+
+    // as in Filter::SetCoefficients(), with the shared terms precalculated
+    switch(mType) {
+        case Peak:
+            if(gainDb >= 0.0) {
+                norm = 1 / (1 + kOverQ + k2);
+                c.a0 = (1 + v * kOverQ + k2) * norm;
+                c.a1 = 2 * (k2 - 1) * norm;
+                c.a2 = (1 - v * kOverQ + k2) * norm;
+                c.b1 = c.a1;
+                c.b2 = (1 - kOverQ + k2) * norm;
+            }
+            else {
+                norm = 1 / (1 + v * kOverQ + k2);
+                c.a0 = (1 + kOverQ + k2) * norm;
+                c.a1 = 2 * (k2 - 1) * norm;
+                c.a2 = (1 - kOverQ + k2) * norm;
+                c.b1 = c.a1;
+                c.b2 = (1 - v * kOverQ + k2) * norm;
+            }
+            break;
+
+        case LowShelf: {
+            const double sqrt2VK = sqrt(2.0 * v) * k;
+
+            if(gainDb >= 0.0) {
+                norm = 1 / (1 + sqrt2K + k2);
+                c.a0 = (1 + sqrt2VK + v * k2) * norm;
+                c.a1 = 2 * (v * k2 - 1) * norm;
+                c.a2 = (1 - sqrt2VK + v * k2) * norm;
+                c.b1 = 2 * (k2 - 1) * norm;
+                c.b2 = (1 - sqrt2K + k2) * norm;
+            }
+            else {
+                norm = 1 / (1 + sqrt2VK + v * k2);
+                c.a0 = (1 + sqrt2K + k2) * norm;
+                c.a1 = 2 * (k2 - 1) * norm;
+                c.a2 = (1 - sqrt2K + k2) * norm;
+                c.b1 = 2 * (v * k2 - 1) * norm;
+                c.b2 = (1 - sqrt2VK + v * k2) * norm;
+            }
+            break;
+        }
+
+        case HighShelf: {
+            const double sqrt2VK = sqrt(2.0 * v) * k;
+
+            if(gainDb >= 0.0) {
+                norm = 1 / (1 + sqrt2K + k2);
+                c.a0 = (v + sqrt2VK + k2) * norm;
+                c.a1 = 2 * (k2 - v) * norm;
+                c.a2 = (v - sqrt2VK + k2) * norm;
+                c.b1 = 2 * (k2 - 1) * norm;
+                c.b2 = (1 - sqrt2K + k2) * norm;
+            }
+            else {
+                norm = 1 / (v + sqrt2VK + k2);
+                c.a0 = (1 + sqrt2K + k2) * norm;
+                c.a1 = 2 * (k2 - 1) * norm;
+                c.a2 = (1 - sqrt2K + k2) * norm;
+                c.b1 = 2 * (k2 - v) * norm;
+                c.b2 = (v - sqrt2VK + k2) * norm;
+            }
+            break;
+        }
+
+        // no gain to modulate
+        case HighPass:
+        case LowPass:
+            c = {};
+            return;
+    }
+
+    // folded into the feedforward coefficients, as DualFilter::BandDesign does
+    if(mMakeupDb != 0.0 && mGainDb != 0.0) {
+        const double makeup = pow(10.0, mMakeupDb * (gainDb / mGainDb) * 0.05);
+        c.a0 *= makeup;
+        c.a1 *= makeup;
+        c.a2 *= makeup;
+    }
+}
@@ -0,0 +1,74 @@
+// Declaration of a dynamic EQ band: an envelope follower drives the band's gain,
+// so it only boosts or cuts while the input is above a threshold.
+//
+// Calling Filter::SetParameters() for every gain change would redo the pow()/tan()
+// work each time, so the frequency-dependent terms come from the band's design
+// (see DualFilter::BandDesign), and only the gain-dependent part of the
+// coefficients is updated (every few samples). The detector is linked across
+// channels, so one update serves them all.
+
+#pragma once
+#include "Filter.h"
+
+class DynamicBand {
+ private:
+    FilterType mType = Peak;
+    double mGainDb {};
+
+    // gain-independent terms, worked out once per band
+    double k {}, k2 {}, kOverQ {}, sqrt2K {};
+
+    // static makeup for the band at its full gain, in dB (0 unless static matching is on)
+    double mMakeupDb {};
+
+    // detector
+    float mEnvelope {}, mAttack {}, mRelease {};
+
+    // the gain the coefficients were last calculated for
+    double mCurrentGainDb {};
+
+    // the band changed, so the coefficients are worked out again at the next update
+    bool mChanged = true;
+
+    BiquadCoefficients mCoefficients;
+
+    int mSampleRate {};
+
+    void UpdateCoefficients(const double& gainDb);
+
+ public:
+    DynamicBand();
+
+    // the detector's rate, which is the host's even when the filters are oversampled
+    void SetSampleRate(const int& sampleRate);
+
+    // prewarp is tan(pi * freq / rate) at the rate the band runs at (see
+    // DualFilter::BandDesign), and gain is the most the band will boost/cut, once the
+    // input is far enough above the threshold. makeupGain is the band's static makeup
+    // at that full gain; it's folded into the coefficients in proportion (in dB) to how
+    // far the gain has moved, so there's none while the input is below the threshold.
+    // cheap enough for the audio thread
+    void SetParameters(const FilterType& type, const double& prewarp,
+                       const double& q, const double& gain, const double& makeupGain);
+
+    void Reset();
+
+    // follows the (linked) input level over a short run of samples, then updates the
+    // coefficients if the gain has moved
+    const BiquadCoefficients& Process(const float* const* channels, const int& numChannels,
+                                      const int& startSample, const int& numSamples);
+
+    // the processor updates the coefficients this often (a few times less often
+    // when it's short of CPU, see QualityScheduler)
+    static constexpr int updateInterval = 16;
+
+    double mThresholdDb = -30.0;
+
+    // how far above the threshold the full gain is reached
+    double mKneeDb = 12.0;
+
+    static constexpr double attackMs = 5.0, releaseMs = 80.0;
+
+    // gain changes smaller than this don't trigger an update
+    static constexpr double gainResolutionDb = 0.01;
+};
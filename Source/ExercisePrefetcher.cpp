@@ -0,0 +1,139 @@
+// Implementation of the background exercise prefetcher
+
+#include "ExercisePrefetcher.h"
+
+ExercisePrefetcher::ExercisePrefetcher(RandomEQProcessor& p) : processorRef(p) {
+    worker->Add(this);
+}
+
+ExercisePrefetcher::~ExercisePrefetcher() {
+    // waits for the worker if it's topping this one up
+    worker->Remove(this);
+}
+
+bool ExercisePrefetcher::TopUp() {
+    if(mFifo.getFreeSpace() < 1)
+        return false;
+
+    // the same as the editor would do for the next exercise
+    mRandom.Randomise(0);
+
+    Exercise exercise;
+    exercise.type = mRandom.mType;
+    exercise.freq = mRandom.mFreq;
+    exercise.gain = mRandom.mGain;
+
+    // not prepared yet means nothing to design for, so the processor will. the makeup
+    // is only worked out when the static match mode will use it
+    const int rate = processorRef.GetDesignRate();
+    const bool withMakeup = processorRef.GetLoudnessMatch() == RandomEQProcessor::MatchStatic;
+
+    for(int mode = 0; mode < NumQModes; ++mode)
+        exercise.band[mode] = DualFilter::Design(exercise.type, exercise.freq, qValues[mode],
+                                                 exercise.gain, rate, withMakeup);
+
+    int start1, size1, start2, size2;
+    mFifo.prepareToWrite(1, start1, size1, start2, size2);
+    mQueue[size1 > 0 ? start1 : start2] = exercise;
+    mFifo.finishedWrite(1);
+
+    return true;
+}
+
+bool ExercisePrefetcher::Pop(Exercise& exercise) {
+    int start1, size1, start2, size2;
+    mFifo.prepareToRead(1, start1, size1, start2, size2);
+
+    const bool ready = size1 + size2 > 0;
+
+    if(ready) {
+        exercise = mQueue[size1 > 0 ? start1 : start2];
+        mFifo.finishedRead(1);
+    }
+
+    // top the queue back up
+    worker->Wake();
+    return ready;
+}
+
+//                                  //                                      //
+
+ExercisePrefetcher::Worker::Worker() : juce::Thread("RandomEQ exercise prefetch") {
+    startThread();
+}
+
+ExercisePrefetcher::Worker::~Worker() {
+    // wakes the worker if it's waiting
+    stopThread(1000);
+}
+
+void ExercisePrefetcher::Worker::Add(ExercisePrefetcher* prefetcher) {
+    {
+        const juce::ScopedLock lock(listLock);
+        prefetchers.add(prefetcher);
+    }
+
+    Wake();
+}
+
+void ExercisePrefetcher::Worker::Remove(ExercisePrefetcher* prefetcher) {
+    {
+        const juce::ScopedLock lock(listLock);
+        prefetchers.removeFirstMatchingValue(prefetcher);
+    }
+
+    // off the list, the worker won't start on it again, but it may be part way through
+    for(;;) {
+        {
+            const juce::ScopedLock lock(listLock);
+
+            if(toppingUp != prefetcher)
+                return;
+        }
+
+        toppedUp.wait(-1);
+    }
+}
+
+void ExercisePrefetcher::Worker::Wake() {
+    notify();
+}
+
+void ExercisePrefetcher::Worker::run() {
+    while(!threadShouldExit()) {
+        bool designed = false;
+
+        {
+            const juce::ScopedLock lock(listLock);
+            pass = prefetchers;
+        }
+
+        for(auto* prefetcher : pass) {
+            if(threadShouldExit())
+                break;
+
+            // skips any that have been removed since the copy
+            {
+                const juce::ScopedLock lock(listLock);
+
+                if(!prefetchers.contains(prefetcher))
+                    continue;
+
+                toppingUp = prefetcher;
+            }
+
+            designed = prefetcher->TopUp() || designed;
+
+            {
+                const juce::ScopedLock lock(listLock);
+                toppingUp = nullptr;
+            }
+
+            toppedUp.signal();
+        }
+
+        // until a queue needs topping up again
+        if(!designed)
+            wait(-1);
+    }
+}
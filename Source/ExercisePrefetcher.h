@@ -0,0 +1,91 @@
+// Declaration of the exercise prefetcher. A background thread keeps a few exercises
+// randomised ahead of time, each with its band already designed (at the host's
+// rate, for every oversampling factor) for both Q modes, so moving on to the next
+// exercise only has to take one off the queue and hand it to the processor. The
+// queue is topped back up in the background after each one is taken.
+//
+// The queue is single producer (the worker) and single consumer (the editor, on the
+// message thread). Exercises designed before a sample rate or match mode change are
+// still used, RandomEQProcessor::SetBand() just designs those bands again.
+//
+// One worker thread serves every open editor in the process, rather than one each,
+// since a session can hold many instances and each queue only needs a few
+// milliseconds of work now and then.
+
+#pragma once
+#include "PluginProcessor.h"
+#include "RandomParameters.h"
+
+class ExercisePrefetcher {
+ public:
+    enum QMode {
+        NormalQ = 0,
+        HighQ,
+        NumQModes
+    };
+
+    static constexpr double qValues[NumQModes] { 0.7, 3.5 };
+
+    struct Exercise {
+        FilterType type = Peak;
+        float freq {}, gain {};
+
+        // every channel runs the same band, so one design per Q mode covers them all
+        DualFilter::BandDesign band[NumQModes];
+    };
+
+ private:
+    RandomEQProcessor& processorRef;
+
+    // only touched by the worker
+    RandomParameters mRandom;
+
+    // one slot is always left empty, so this holds three exercises
+    static constexpr int queueSize = 4;
+    Exercise mQueue[queueSize];
+    juce::AbstractFifo mFifo { queueSize };
+
+    // designs one exercise into the queue, returns false if it's already full.
+    // worker only
+    bool TopUp();
+
+    // the thread shared by every prefetcher, started with the first and stopped with
+    // the last. it goes round them one exercise at a time until all are full
+    class Worker : private juce::Thread {
+     private:
+        // guards the list and which prefetcher is being topped up. it isn't held while
+        // designing, so closing an editor only waits for its own exercise, if any
+        juce::CriticalSection listLock;
+        juce::Array<ExercisePrefetcher*> prefetchers;
+        ExercisePrefetcher* toppingUp = nullptr;
+
+        // signalled after each exercise, for Remove() to wait on
+        juce::WaitableEvent toppedUp;
+
+        // the worker's copy of the list, to go round without the lock
+        juce::Array<ExercisePrefetcher*> pass;
+
+        void run() override;
+
+     public:
+        Worker();
+        ~Worker() override;
+
+        void Add(ExercisePrefetcher*);
+        void Remove(ExercisePrefetcher*);
+
+        // wakes the worker to top the queues up
+        void Wake();
+    };
+
+    juce::SharedResourcePointer<Worker> worker;
+
+ public:
+    // joins the worker, which fills the queue straight away
+    explicit ExercisePrefetcher(RandomEQProcessor&);
+    ~ExercisePrefetcher();
+
+    // takes the next exercise off the queue, returns false if none are ready yet.
+    // message thread only
+    bool Pop(Exercise&);
+};
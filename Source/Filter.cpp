@@ -3,6 +3,7 @@
 
 #include "Filter.h"
 #include "FastSqrt.h"
+#include "Trace.h"
 
 Filter::Filter() {
     // initialise values
@@ -15,7 +16,12 @@ Filter::Filter() {
 }
 
 void Filter::SetSampleRate(const int& sampleRate) {
+    const bool changed = sampleRate != mSampleRate;
     this->mSampleRate = sampleRate;
+
+    // the band stays where it was, rather than keeping coefficients for the old rate
+    if(changed)
+        SetCoefficients();
 }
 
 void Filter::SetParameters(const FilterType& type, const double& freq,
@@ -31,11 +37,48 @@ void Filter::SetParameters(const FilterType& type, const double& freq,
     SetCoefficients();
 }
 
+void Filter::SetParameters(const FilterType& type, const double& freq, const double& q,
+                           const double& gain, const BiquadCoefficients& coefficients) {
+    if(!mEnabled)
+        return;
+
+    this->mType = type;
+    this->mFreq = freq;
+    this->mQ = q;
+    this->mGain = gain;
+
+    a0 = coefficients.a0;
+    a1 = coefficients.a1;
+    a2 = coefficients.a2;
+    b1 = coefficients.b1;
+    b2 = coefficients.b2;
+}
+
 int Filter::GetCoefficientProcessTime() const {
     return coefCalculateTime;
 }
 
+BiquadCoefficients Filter::GetCoefficients() const {
+    return { a0, a1, a2, b1, b2 };
+}
+
+double Filter::GetMagnitude(const double& freq) const {
+    const double w = 2.0 * M_PI * freq / mSampleRate,
+                 cos1 = cos(w), sin1 = sin(w),
+                 cos2 = cos(2.0 * w), sin2 = sin(2.0 * w);
+
+    // evaluate numerator and denominator on the unit circle
+    const double numRe = a0 + a1 * cos1 + a2 * cos2,
+                 numIm = -(a1 * sin1 + a2 * sin2),
+                 denRe = 1.0 + b1 * cos1 + b2 * cos2,
+                 denIm = -(b1 * sin1 + b2 * sin2);
+
+    return sqrt((numRe * numRe + numIm * numIm) / (denRe * denRe + denIm * denIm));
+}
+
 void Filter::SetCoefficients() {
+    TRACE_SCOPE("Filter::SetCoefficients");
+
     if(!useFastProcessing) {
         SetCoefficientsSlow();
         return;
@@ -49,8 +92,8 @@ void Filter::SetCoefficients() {
            k2 = k * k,
            sqrt2V_K = 0.0, sqrt2_K = 0.0;
 
-    // small optimisation to skip processing time for peak filter
-    if(this->mType != Peak) {
+    // small optimisation to skip processing time for non-shelf filters
+    if(this->mType == LowShelf || this->mType == HighShelf) {
         sqrt2V_K = (useFastProcessing ? FastSqrt::FS1(2.0 * v) : sqrt(2.0 * v)) * k;
         sqrt2_K = sqrt2 * k;
     }
@@ -113,6 +156,25 @@ void Filter::SetCoefficients() {
                 b2 = (1 - v / mQ * k + k2) * norm;
             }
             break;
+
+        // gain is ignored for both passes
+        case HighPass:
+            norm = 1 / (1 + k / mQ + k2);
+            a0 = norm;
+            a1 = -2 * a0;
+            a2 = a0;
+            b1 = 2 * (k2 - 1) * norm;
+            b2 = (1 - k / mQ + k2) * norm;
+            break;
+
+        case LowPass:
+            norm = 1 / (1 + k / mQ + k2);
+            a0 = k2 * norm;
+            a1 = 2 * a0;
+            a2 = a0;
+            b1 = 2 * (k2 - 1) * norm;
+            b2 = (1 - k / mQ + k2) * norm;
+            break;
     }
 
     auto tEnd = std::chrono::high_resolution_clock::now();
@@ -123,7 +185,7 @@ void Filter::SetCoefficientsSlow() {
     auto tStart = std::chrono::high_resolution_clock::now();
 
     double norm = 0.0,
-           v = pow(10, abs(mGain) / 20),
+           v = pow(10, fabs(mGain) / 20),
            k = tan(M_PI * (mFreq / mSampleRate));
 
     // NOTE despite being more precise, this can still be optimised without losing
@@ -132,38 +194,38 @@ void Filter::SetCoefficientsSlow() {
         case LowShelf:
             if(mGain >= 0.0) {
                 norm = 1 / (1 + sqrt(2) * k + k * k);
-                a0 = (1 + sqrt(2.0 * v) + v * k * k) * norm;
+                a0 = (1 + sqrt(2.0 * v) * k + v * k * k) * norm;
                 a1 = 2 * (v * k * k - 1) * norm;
-                a2 = (1 - sqrt(2.0 * v) + v * k * k) * norm;
+                a2 = (1 - sqrt(2.0 * v) * k + v * k * k) * norm;
                 b1 = 2 * (k * k - 1) * norm;
                 b2 = (1 - sqrt(2) * k + k * k) * norm;
             }
             else {
-                norm = 1 / (1 + sqrt(2.0 * v) + v * k * k);
+                norm = 1 / (1 + sqrt(2.0 * v) * k + v * k * k);
                 a0 = (1 + sqrt(2) * k + k * k) * norm;
                 a1 = 2 * (k * k - 1) * norm;
                 a2 = (1 - sqrt(2) * k + k * k) * norm;
                 b1 = 2 * (v * k * k - 1) * norm;
-                b2 = (1 - sqrt(2.0 * v) + v * k * k) * norm;
+                b2 = (1 - sqrt(2.0 * v) * k + v * k * k) * norm;
             }
             break;
 
         case HighShelf:
             if(mGain >= 0.0) {
                 norm = 1 / (1 + sqrt(2) * k + k * k);
-                a0 = (v + sqrt(2.0 * v) + k * k) * norm;
+                a0 = (v + sqrt(2.0 * v) * k + k * k) * norm;
                 a1 = 2 * (k * k - v) * norm;
-                a2 = (v - sqrt(2.0 * v) + k * k) * norm;
+                a2 = (v - sqrt(2.0 * v) * k + k * k) * norm;
                 b1 = 2 * (k * k - 1) * norm;
                 b2 = (1 - sqrt(2) * k + k * k) * norm;
             }
             else {
-                norm = 1 / (v + sqrt(2.0 * v) + k * k);
+                norm = 1 / (v + sqrt(2.0 * v) * k + k * k);
                 a0 = (1 + sqrt(2) * k + k * k) * norm;
                 a1 = 2 * (k * k - 1) * norm;
                 a2 = (1 - sqrt(2) * k + k * k) * norm;
                 b1 = 2 * (k * k - v) * norm;
-                b2 = (v - sqrt(2.0 * v) + k * k) * norm;
+                b2 = (v - sqrt(2.0 * v) * k + k * k) * norm;
             }
             break;
 
@@ -185,6 +247,24 @@ void Filter::SetCoefficientsSlow() {
                 b2 = (1 - v / mQ * k + k * k) * norm;
             }
             break;
+
+        case HighPass:
+            norm = 1 / (1 + k / mQ + k * k);
+            a0 = norm;
+            a1 = -2 * a0;
+            a2 = a0;
+            b1 = 2 * (k * k - 1) * norm;
+            b2 = (1 - k / mQ + k * k) * norm;
+            break;
+
+        case LowPass:
+            norm = 1 / (1 + k / mQ + k * k);
+            a0 = k * k * norm;
+            a1 = 2 * a0;
+            a2 = a0;
+            b1 = 2 * (k * k - 1) * norm;
+            b2 = (1 - k / mQ + k * k) * norm;
+            break;
     }
 
     auto tEnd = std::chrono::high_resolution_clock::now();
@@ -201,12 +281,10 @@ double Filter::Process(const double& in) {
     return out;
 }
 
+// float in and out, but the state and the fed-back output stay in double. rounding
+// the output before it's fed back is what made low bands at high sample rates
+// noisy (the poles sit right next to z = 1, so the error gets amplified), and the
+// round trip through float was on the critical path anyway
 float Filter::Process(const float& in) {
-    if(!mEnabled)
-        return in;
-
-    float out = in * a0 + z1;
-    z1 = in * a1 + z2 - b1 * out;
-    z2 = in * a2 - b2 * out;
-    return out;
+    return (float)Process((double)in);
 }
\ No newline at end of file
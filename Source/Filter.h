@@ -9,25 +9,43 @@
 enum FilterType {
     LowShelf = 1,
     HighShelf,
-    Peak
+    Peak,
+    HighPass,
+    LowPass
+};
+
+// a copy of a biquad's coefficients, so they can be moved between filters
+// (or processing lanes) without recalculating them
+struct BiquadCoefficients {
+    double a0 = 1.0, a1 {}, a2 {}, b1 {}, b2 {};
 };
 
 class Filter {
+ private:
+    // everything Process() reads or writes on each sample (56 bytes), kept together in
+    // one cache line so a session full of instances touches as little memory as
+    // possible. a0 is declared on its own because alignas would apply to every
+    // declarator in the list, and only the first member needs to start the line
+    alignas(64) double a0 {};
+    double a1 {}, a2 {}, b1 {}, b2 {},
+           z1 {}, z2 {};
+
+ public:
+    // used to bypass the filter processing (saves performance too)
+    bool mEnabled = true;
+
  private:
     void SetCoefficients();
     // slower (but more accurate) coefficient calculations, mainly applies to shelves
     void SetCoefficientsSlow();
 
     // precalculate sqrt(2) to improve performance
-    const double sqrt2 = sqrt(2);
+    static constexpr double sqrt2 = 1.41421356237309504880;
 
+    // parameters and timing are only touched when the coefficients change
     FilterType mType {};
     int mSampleRate {};
-
-    // coefficients / processing / parameters
-    double a0 {}, a1 {}, a2 {}, b1 {}, b2 {},
-           z1 {}, z2 {},
-           mFreq {}, mGain {};
+    double mFreq {}, mGain {};
 
     int coefCalculateTime {};
 
@@ -39,6 +57,10 @@ class Filter {
     void SetParameters(const FilterType& type, const double& freq,
                        const double& q, const double& gain);
 
+    // as above, with coefficients already worked out elsewhere (for this sample rate)
+    void SetParameters(const FilterType& type, const double& freq, const double& q,
+                       const double& gain, const BiquadCoefficients& coefficients);
+
     double Process(const double&);
     float Process(const float&);
 
@@ -46,8 +68,10 @@ class Filter {
     // because why not, it's stupid fast
     int GetCoefficientProcessTime() const;
 
-    // used to bypass the filter processing (saves performance too)
-    bool mEnabled = true;
+    BiquadCoefficients GetCoefficients() const;
+
+    // linear magnitude of the current response at the given frequency
+    double GetMagnitude(const double& freq) const;
 
     double mQ {};
 
@@ -0,0 +1,414 @@
+// Implementation of the K-weighted loudness meter used for level matching
+
+#include "LoudnessMeter.h"
+#include "RealtimeCheck.h"
+
+namespace {
+    // below this (roughly -70 LUFS) the makeup gain is held, rather than chasing noise
+    constexpr double silenceMeanSquare = 1e-7;
+
+    // BS.1770 pre-filter (a high shelf) and RLB weighting (a high-pass), from the
+    // analogue prototypes the standard's 48 kHz coefficients were derived from, so
+    // they can be redesigned at any rate. the regular shelf's fast path falls a dB
+    // short of the +4 dB plateau, hence doing it by hand
+    void DesignKWeighting(Filter& shelf, Filter& highPass, const double& sampleRate) {
+        constexpr double shelfFreq = 1681.974450955533, shelfQ = 0.7071752369554196,
+                         shelfGainDb = 3.999843853973347, shelfBandExponent = 0.4996667741545416,
+                         highPassFreq = 38.13547087602444, highPassQ = 0.5003270373238773;
+
+        double k = tan(M_PI * shelfFreq / sampleRate);
+        const double vh = pow(10.0, shelfGainDb / 20.0),
+                     vb = pow(vh, shelfBandExponent);
+
+        double norm = 1.0 / (1.0 + k / shelfQ + k * k);
+
+        const BiquadCoefficients shelfCoefficients {
+            (vh + vb * k / shelfQ + k * k) * norm,
+            2.0 * (k * k - vh) * norm,
+            (vh - vb * k / shelfQ + k * k) * norm,
+            2.0 * (k * k - 1.0) * norm,
+            (1.0 - k / shelfQ + k * k) * norm
+        };
+
+        k = tan(M_PI * highPassFreq / sampleRate);
+        norm = 1.0 / (1.0 + k / highPassQ + k * k);
+
+        // left unnormalised, as in the standard (it's 0 dB at 1 kHz once the shelf is on)
+        const BiquadCoefficients highPassCoefficients {
+            1.0, -2.0, 1.0,
+            2.0 * (k * k - 1.0) * norm,
+            (1.0 - k / highPassQ + k * k) * norm
+        };
+
+        shelf.SetSampleRate((int)sampleRate);
+        shelf.SetParameters(HighShelf, shelfFreq, shelfQ, shelfGainDb, shelfCoefficients);
+
+        highPass.SetSampleRate((int)sampleRate);
+        highPass.SetParameters(HighPass, highPassFreq, highPassQ, 0.0, highPassCoefficients);
+    }
+}
+
+void LoudnessMeter::SetSampleRate(const int& sampleRate, const int& maximumBlockSize) {
+    RT_ASSERT_NOT_AUDIO_THREAD("LoudnessMeter::SetSampleRate() allocates");
+
+    this->mSampleRate = sampleRate;
+
+    // a power of two, so whole groups can be summed a pair of samples at a time
+    mBaseDecimation = 1;
+    while(sampleRate / (mBaseDecimation * 2) >= minimumMeterRate)
+        mBaseDecimation *= 2;
+
+    mDecimation = mBaseDecimation;
+    DesignStages();
+
+    mMaximumBlockSize = maximumBlockSize;
+
+    // one more for the group carried over from the last block
+    mAveraged.assign((size_t)(maximumBlockSize / mDecimation + 1) * numSignals, 0.0f);
+    mScratch.assign((size_t)maximumBlockSize, 0.0f);
+
+    Reset();
+}
+
+void LoudnessMeter::DesignStages() {
+    const double meterRate = (double)mSampleRate / mDecimation;
+
+    Filter shelf, highPass;
+    DesignKWeighting(shelf, highPass, meterRate);
+
+    mShelf.SetCoefficients(shelf.GetCoefficients());
+    mHighPass.SetCoefficients(highPass.GetCoefficients());
+
+    // what the averaging takes out sits above the averaged rate's Nyquist, where the
+    // shelf is still rising a little, so it's added back at the full-rate weighting's
+    // power gain averaged over that range (as GetStaticMakeupGain() does, for a pink
+    // spectrum). whatever's above 20 kHz is measured, but left out of the average
+    constexpr int numPoints = 16;
+
+    const double lowFreq = meterRate * 0.5,
+                 highFreq = mSampleRate * 0.5 < 20000.0 ? mSampleRate * 0.5 : 20000.0;
+
+    DesignKWeighting(shelf, highPass, mSampleRate);
+    mHighGain = 0.0;
+
+    for(int i = 0; i < numPoints; ++i) {
+        const double freq = lowFreq * pow(highFreq / lowFreq, (i + 0.5) / numPoints);
+        const double gain = shelf.GetMagnitude(freq) * highPass.GetMagnitude(freq);
+        mHighGain += gain * gain / numPoints;
+    }
+}
+
+void LoudnessMeter::SetReducedRate(const bool& reduced) {
+    // not so low that the weighting's shelf runs into the meter's Nyquist
+    const bool lower = reduced && mSampleRate / (mBaseDecimation * 2) >= minimumReducedMeterRate;
+    const int decimation = lower ? mBaseDecimation * 2 : mBaseDecimation;
+    if(decimation == mDecimation)
+        return;
+
+    mDecimation = decimation;
+    DesignStages();
+
+    mShelf.Reset();
+    mHighPass.Reset();
+
+    for(int channel = 0; channel < maximumChannels; ++channel)
+        mPartialIn[channel] = mPartialOut[channel] = 0.0f;
+
+    mPartialCount = 0;
+}
+
+void LoudnessMeter::Stage::SetCoefficients(const BiquadCoefficients& c) {
+    for(int lane = 0; lane < numSignals; ++lane) {
+        a0[lane] = (float)c.a0;
+        a1[lane] = (float)c.a1;
+        a2[lane] = (float)c.a2;
+        b1[lane] = (float)c.b1;
+        b2[lane] = (float)c.b2;
+    }
+}
+
+void LoudnessMeter::Stage::Reset() {
+    for(int lane = 0; lane < numSignals; ++lane)
+        z1[lane] = z2[lane] = y[lane] = 0.0f;
+}
+
+void LoudnessMeter::Reset() {
+    mShelf.Reset();
+    mHighPass.Reset();
+
+    for(int channel = 0; channel < maximumChannels; ++channel)
+        mPartialIn[channel] = mPartialOut[channel] = 0.0f;
+
+    mPartialCount = 0;
+    mBlockSquaresIn = 0.0;
+    mMeanSquareIn = mMeanSquareOut = 0.0;
+    mMakeupGain = 1.0f;
+}
+
+int LoudnessMeter::Average(const float* in, const int& numSamples, float& partial,
+                           float* out, double& squares) {
+    const float scale = 1.0f / (float)mDecimation;
+
+    // finish the group the last block started, then whole groups, then start the next
+    const int head = mDecimation - mPartialCount;
+
+    if(head > numSamples) {
+        for(int i = 0; i < numSamples; ++i) {
+            partial += in[i];
+            squares += in[i] * in[i];
+        }
+
+        return 0;
+    }
+
+    for(int i = 0; i < head; ++i) {
+        partial += in[i];
+        squares += in[i] * in[i];
+    }
+
+    out[0] = partial * scale;
+
+    const int groups = (numSamples - head) / mDecimation;
+
+    // whole groups are summed a pair of samples at a time, so each pass is a plain
+    // loop that compiles to SIMD. the first pass squares the samples as it goes (four
+    // independent sums, for the same reason), so the input is only read once. the
+    // passes go back and forth between the two halves of the scratch buffer
+    const float* source = in + head;
+    float* scratch = mScratch.data();
+    const size_t half = mScratch.size() / 2;
+    int length = groups * mDecimation;
+    float sum[4] {};
+
+    if(mDecimation == 1) {
+        int i = 0;
+
+        for(; i + 4 <= length; i += 4) {
+            for(int lane = 0; lane < 4; ++lane)
+                sum[lane] += source[i + lane] * source[i + lane];
+        }
+
+        for(; i < length; ++i)
+            sum[0] += source[i] * source[i];
+    }
+
+    for(int width = mDecimation; width > 1; width /= 2) {
+        length /= 2;
+
+        if(width == mDecimation) {
+            int i = 0;
+
+            for(; i + 4 <= length; i += 4) {
+                for(int lane = 0; lane < 4; ++lane) {
+                    const float a = source[2 * (i + lane)], b = source[2 * (i + lane) + 1];
+                    scratch[i + lane] = a + b;
+                    sum[lane] += a * a + b * b;
+                }
+            }
+
+            for(; i < length; ++i) {
+                const float a = source[2 * i], b = source[2 * i + 1];
+                scratch[i] = a + b;
+                sum[0] += a * a + b * b;
+            }
+        }
+        else {
+            for(int i = 0; i < length; ++i)
+                scratch[i] = source[2 * i] + source[2 * i + 1];
+        }
+
+        source = scratch;
+        scratch = source == mScratch.data() ? mScratch.data() + half : mScratch.data();
+    }
+
+    squares += (sum[0] + sum[1]) + (sum[2] + sum[3]);
+
+    for(int group = 0; group < groups; ++group)
+        out[(size_t)(group + 1) * numSignals] = source[group] * scale;
+
+    partial = 0.0f;
+
+    for(int sample = head + groups * mDecimation; sample < numSamples; ++sample) {
+        partial += in[sample];
+        squares += in[sample] * in[sample];
+    }
+
+    return groups + 1;
+}
+
+void LoudnessMeter::CaptureInput(const float* const* channels, const int& numChannels,
+                                 const int& blockSize) {
+    // anything past the size it was prepared for goes unmetered
+    const int numSamples = blockSize < mMaximumBlockSize ? blockSize : mMaximumBlockSize;
+    const int metered = numChannels < maximumChannels ? numChannels : maximumChannels;
+
+    mBlockSquaresIn = 0.0;
+
+    for(int channel = 0; channel < metered; ++channel)
+        Average(channels[channel], numSamples, mPartialIn[channel],
+                mAveraged.data() + InStage + channel, mBlockSquaresIn);
+}
+
+void LoudnessMeter::Weight(const float* signals, const int& numGroups,
+                           float* averagedSquares, float* weightedSquares) {
+    // everything is worked on in locals, so the compiler can keep it in registers
+    // between groups (the signals could alias the stages, as far as it knows)
+    float shelf0[numSignals], shelf1[numSignals], shelf2[numSignals],
+          shelfB1[numSignals], shelfB2[numSignals],
+          highPass0[numSignals], highPass1[numSignals], highPass2[numSignals],
+          highPassB1[numSignals], highPassB2[numSignals],
+          shelfZ1[numSignals], shelfZ2[numSignals], shelfOut[numSignals],
+          highPassZ1[numSignals], highPassZ2[numSignals], sumOut[numSignals] {};
+
+    for(int lane = 0; lane < numSignals; ++lane) {
+        shelf0[lane] = mShelf.a0[lane];
+        shelf1[lane] = mShelf.a1[lane];
+        shelf2[lane] = mShelf.a2[lane];
+        shelfB1[lane] = mShelf.b1[lane];
+        shelfB2[lane] = mShelf.b2[lane];
+        shelfZ1[lane] = mShelf.z1[lane];
+        shelfZ2[lane] = mShelf.z2[lane];
+        shelfOut[lane] = mShelf.y[lane];
+
+        highPass0[lane] = mHighPass.a0[lane];
+        highPass1[lane] = mHighPass.a1[lane];
+        highPass2[lane] = mHighPass.a2[lane];
+        highPassB1[lane] = mHighPass.b1[lane];
+        highPassB2[lane] = mHighPass.b2[lane];
+        highPassZ1[lane] = mHighPass.z1[lane];
+        highPassZ2[lane] = mHighPass.z2[lane];
+    }
+
+    for(int group = 0; group < numGroups; ++group) {
+        const float* x = signals + group * numSignals;
+
+        for(int lane = 0; lane < numSignals; ++lane) {
+            // the high-pass lags the shelf by one group, so the two don't wait on
+            // each other (which doesn't change the power)
+            const float lagged = shelfOut[lane];
+
+            const float y = x[lane] * shelf0[lane] + shelfZ1[lane];
+            shelfZ1[lane] = x[lane] * shelf1[lane] + shelfZ2[lane] - shelfB1[lane] * y;
+            shelfZ2[lane] = x[lane] * shelf2[lane] - shelfB2[lane] * y;
+            shelfOut[lane] = y;
+
+            const float k = lagged * highPass0[lane] + highPassZ1[lane];
+            highPassZ1[lane] = lagged * highPass1[lane] + highPassZ2[lane] - highPassB1[lane] * k;
+            highPassZ2[lane] = lagged * highPass2[lane] - highPassB2[lane] * k;
+
+            sumOut[lane] += k * k;
+        }
+    }
+
+    // a pass of its own, there aren't enough registers to do it above
+    float sumIn[numSignals] {};
+
+    for(int group = 0; group < numGroups; ++group) {
+        const float* x = signals + group * numSignals;
+
+        for(int lane = 0; lane < numSignals; ++lane)
+            sumIn[lane] += x[lane] * x[lane];
+    }
+
+    for(int lane = 0; lane < numSignals; ++lane) {
+        mShelf.z1[lane] = shelfZ1[lane];
+        mShelf.z2[lane] = shelfZ2[lane];
+        mShelf.y[lane] = shelfOut[lane];
+        mHighPass.z1[lane] = highPassZ1[lane];
+        mHighPass.z2[lane] = highPassZ2[lane];
+    }
+
+    for(int lane = 0; lane < numSignals; ++lane) {
+        averagedSquares[lane] = sumIn[lane];
+        weightedSquares[lane] = sumOut[lane];
+    }
+}
+
+void LoudnessMeter::ProcessOutput(const float* const* channels, const int& numChannels,
+                                  const int& blockSize) {
+    const int numSamples = blockSize < mMaximumBlockSize ? blockSize : mMaximumBlockSize;
+    const int metered = numChannels < maximumChannels ? numChannels : maximumChannels;
+
+    double squaresOut = 0.0;
+    int n = 0;
+
+    for(int channel = 0; channel < metered; ++channel)
+        n = Average(channels[channel], numSamples, mPartialOut[channel],
+                    mAveraged.data() + OutStage + channel, squaresOut);
+
+    // the input was averaged over the same groups, so they finish together
+    mPartialCount = (mPartialCount + numSamples) % mDecimation;
+
+    if(n == 0)
+        return;
+
+    // unmetered channels just run silence through their lanes
+    for(int channel = metered; channel < maximumChannels; ++channel) {
+        for(size_t group = 0; group < (size_t)n; ++group) {
+            mAveraged[group * numSignals + InStage + (size_t)channel] = 0.0f;
+            mAveraged[group * numSignals + OutStage + (size_t)channel] = 0.0f;
+        }
+    }
+
+    // a block is short enough to sum the squares in float
+    float averaged[numSignals], weighted[numSignals];
+    Weight(mAveraged.data(), n, averaged, weighted);
+
+    double averagedIn = 0.0, averagedOut = 0.0, weightedIn = 0.0, weightedOut = 0.0;
+
+    for(int channel = 0; channel < maximumChannels; ++channel) {
+        averagedIn += averaged[InStage + channel];
+        averagedOut += averaged[OutStage + channel];
+        weightedIn += weighted[InStage + channel];
+        weightedOut += weighted[OutStage + channel];
+    }
+
+    // the weighted low end, plus whatever the averaging took out at the weighting's
+    // top-end gain (the averaged power can come out a touch above the full one)
+    auto blockPower = [&](const double& low, const double& squares, const double& lowSquares) {
+        const double high = squares / numSamples - lowSquares / n;
+        return low / n + (high > 0.0 ? mHighGain * high : 0.0);
+    };
+
+    // one-pole integration, scaled by the length of the block
+    const double coef = 1.0 - exp(-(double)numSamples / (integrationTimeSeconds * mSampleRate));
+
+    mMeanSquareIn += coef * (blockPower(weightedIn, mBlockSquaresIn, averagedIn) - mMeanSquareIn);
+    mMeanSquareOut += coef * (blockPower(weightedOut, squaresOut, averagedOut) - mMeanSquareOut);
+
+    if(mMeanSquareIn < silenceMeanSquare || mMeanSquareOut < silenceMeanSquare)
+        return;
+
+    const float maxGain = powf(10.0f, maximumMakeupDb * 0.05f);
+    const float gain = (float)sqrt(mMeanSquareIn / mMeanSquareOut);
+
+    mMakeupGain = gain > maxGain ? maxGain : (gain < 1.0f / maxGain ? 1.0f / maxGain : gain);
+}
+
+float LoudnessMeter::GetMakeupGain() const {
+    return mMakeupGain;
+}
+
+double LoudnessMeter::GetStaticMakeupGain(const Filter& band, const int& sampleRate) {
+    constexpr int numPoints = 64;
+    constexpr double lowFreq = 20.0;
+
+    const double highFreq = sampleRate * 0.45 < 20000.0 ? sampleRate * 0.45 : 20000.0;
+
+    Filter shelf, highPass;
+    DesignKWeighting(shelf, highPass, sampleRate);
+
+    // log-spaced points give every octave equal weight, i.e. a pink spectrum
+    double weighted = 0.0, total = 0.0;
+
+    for(int i = 0; i < numPoints; ++i) {
+        const double freq = lowFreq * pow(highFreq / lowFreq, (double)i / (numPoints - 1));
+        const double k = shelf.GetMagnitude(freq) * highPass.GetMagnitude(freq),
+                     h = band.GetMagnitude(freq);
+
+        weighted += k * k * h * h;
+        total += k * k;
+    }
+
+    return weighted > 0.0 ? sqrt(total / weighted) : 1.0;
+}
@@ -0,0 +1,117 @@
+// Declaration of a block-based, K-weighted (ITU-R BS.1770) loudness meter that
+// compares the dry input against the processed output, and derives the makeup
+// gain needed to match their levels. Boosts shouldn't be guessable by loudness.
+//
+// As in BS.1770, each channel is weighted and its mean square summed, so content
+// that's out of phase between the channels counts in full. The weighting runs at
+// a reduced rate to keep the meter cheap: each channel is averaged down over
+// groups of samples (to at least 5512 Hz), then both K-weighting stages run with
+// the input and output of both channels as four float lanes (the second stage is
+// fed the first stage's previous output, so the two don't wait on each other).
+// Averaging is a low-pass of its own, which keeps the high end from folding back
+// into the weighted band; the power it takes out is measured at the full rate and
+// added back at the weighting's average gain over that range.
+//
+// At 88.2 kHz and up, the input's content above 20 kHz is metered too (as BS.1770
+// would), at the shelf's +4 dB. GetStaticMakeupGain() stops at 20 kHz, so on test
+// noise that runs to Nyquist the two modes can differ by around half a dB there.
+
+#pragma once
+#include "Filter.h"
+
+class LoudnessMeter {
+ public:
+    static constexpr int maximumChannels = 2;
+
+ private:
+    // the input and output of each channel are the lanes of each weighting stage
+    enum Signal {
+        InStage = 0,
+        OutStage = maximumChannels,
+        numSignals = maximumChannels * 2
+    };
+
+    // one K-weighting stage for every signal
+    struct Stage {
+        alignas(16) float a0[numSignals] {}, a1[numSignals] {}, a2[numSignals] {},
+                          b1[numSignals] {}, b2[numSignals] {},
+                          z1[numSignals] {}, z2[numSignals] {}, y[numSignals] {};
+
+        void SetCoefficients(const BiquadCoefficients&);
+        void Reset();
+    };
+
+    Stage mShelf, mHighPass;
+
+    // the averaged input and output of each channel, interleaved ([group][signal])
+    // with room for a block's worth. the input is captured before the filters
+    // overwrite it
+    std::vector<float> mAveraged;
+
+    // for summing groups down a pair at a time
+    std::vector<float> mScratch;
+
+    // a group that runs over the end of a block is finished in the next one
+    float mPartialIn[maximumChannels] {}, mPartialOut[maximumChannels] {};
+    int mPartialCount {};
+
+    // the input's full-rate power for this block, summed over channels
+    double mBlockSquaresIn {};
+
+    int mSampleRate {}, mMaximumBlockSize {}, mBaseDecimation = 1, mDecimation = 1;
+
+    // power gain of the weighting above the averaged rate's Nyquist (averaged over
+    // it), applied to whatever the averaging took out
+    double mHighGain = 1.0;
+
+    double mMeanSquareIn {}, mMeanSquareOut {};
+    float mMakeupGain = 1.0f;
+
+    // designs the K-weighting stages for the current decimation
+    void DesignStages();
+
+    // averages one channel into groups of mDecimation (written numSignals apart),
+    // finishing off the group left over from the last block, and returns the number
+    // of groups. the sum of squares is over every sample
+    int Average(const float* in, const int& numSamples, float& partial, float* out,
+                double& squares);
+
+    // K-weights the averaged signals, four lanes at a time, summing the squares
+    // going in and coming out of each lane
+    void Weight(const float* signals, const int& numGroups,
+                float* averagedSquares, float* weightedSquares);
+
+ public:
+    // allocates, so call from prepareToPlay() rather than the audio thread
+    void SetSampleRate(const int& sampleRate, const int& maximumBlockSize);
+
+    void Reset();
+
+    // averages over twice as many samples, for when the CPU is short (unless that
+    // would take the meter under minimumReducedMeterRate). the measurement carries
+    // on across the switch, only the filters start again
+    void SetReducedRate(const bool& reduced);
+
+    // channels past maximumChannels aren't metered
+    void CaptureInput(const float* const* channels, const int& numChannels,
+                      const int& numSamples);
+
+    void ProcessOutput(const float* const* channels, const int& numChannels,
+                       const int& numSamples);
+
+    // gain that brings the output back to the level of the input
+    float GetMakeupGain() const;
+
+    // makeup gain for a band, estimated from its response rather than measured
+    // (assumes a pink-ish input spectrum)
+    static double GetStaticMakeupGain(const Filter& band, const int& sampleRate);
+
+    // how quickly the measurement follows the signal
+    static constexpr double integrationTimeSeconds = 1.5;
+
+    // the meter's own sample rate is kept at or above this, and at or above the
+    // second when it's reduced (the weighting's shelf is at 1.7 kHz)
+    static constexpr int minimumMeterRate = 5512, minimumReducedMeterRate = 4000;
+
+    static constexpr float maximumMakeupDb = 24.0f;
+};
@@ -0,0 +1,306 @@
+// Implementation of the polyphase half-band oversampler
+
+#include "Oversampler.h"
+#include "Filter.h"
+#include "RealtimeCheck.h"
+#include <algorithm>
+#include <cmath>
+
+// zeroth-order modified Bessel function, for the Kaiser window
+static double BesselI0(const double& x) {
+    double sum = 1.0, term = 1.0;
+
+    for(int k = 1; k < 50 && term > sum * 1e-12; ++k) {
+        const double half = x / (2.0 * k);
+        term *= half * half;
+        sum += term;
+    }
+
+    return sum;
+}
+
+void Oversampler::HalfBand::Design(const int& delay, const double& beta,
+                                   const int& maximumBlockSize) {
+    mDelay = delay;
+
+    const int centre = 2 * delay + 1,
+              phaseTaps = 2 * delay + 2;
+
+    mNumTaps = (phaseTaps + 3) / 4 * 4;
+
+    // every even-numbered tap from the centre is zero (and the centre is 0.5), so only
+    // the odd ones are worked out. they're stored newest last, to line up with the history
+    double taps[maximumTaps] {}, sum = 0.0;
+
+    for(int lag = 0; lag < phaseTaps; ++lag) {
+        const int n = 2 * lag - centre;
+        const double r = (double)n / centre;
+
+        taps[lag] = sin(M_PI * n * 0.5) / (M_PI * n)
+                  * BesselI0(beta * sqrt(1.0 - r * r)) / BesselI0(beta);
+        sum += taps[lag];
+    }
+
+    // the filtered phase has to pass DC exactly like the delayed one does
+    for(int i = 0; i < maximumTaps; ++i)
+        mCoefficients[i] = 0.0f;
+
+    for(int lag = 0; lag < phaseTaps; ++lag)
+        mCoefficients[mNumTaps - 1 - lag] = (float)(taps[lag] * 0.5 / sum);
+
+    mUpInput.assign((size_t)(mNumTaps + maximumBlockSize), 0.0f);
+    mEvenInput.assign((size_t)(mNumTaps + maximumBlockSize), 0.0f);
+    mOddInput.assign((size_t)(mNumTaps + maximumBlockSize), 0.0f);
+}
+
+void Oversampler::HalfBand::Reset() {
+    std::fill(mUpInput.begin(), mUpInput.end(), 0.0f);
+    std::fill(mEvenInput.begin(), mEvenInput.end(), 0.0f);
+    std::fill(mOddInput.begin(), mOddInput.end(), 0.0f);
+}
+
+float Oversampler::HalfBand::Dot(const float* window) const {
+    // four independent sums, so each step is one four-wide multiply-add
+    float sum[4] {};
+
+    for(int i = 0; i < mNumTaps; i += 4) {
+        for(int lane = 0; lane < 4; ++lane)
+            sum[lane] += window[i + lane] * mCoefficients[i + lane];
+    }
+
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+void Oversampler::HalfBand::Up(const float* in, float* out, const int& numSamples) {
+    float* input = mUpInput.data();
+    std::copy(in, in + numSamples, input + mNumTaps);
+
+    for(int sample = 0; sample < numSamples; ++sample) {
+        const float* window = input + sample + 1;
+
+        // x2 makes up for the zeros the other phase would have stuffed in
+        out[2 * sample] = 2.0f * Dot(window);
+        out[2 * sample + 1] = window[mNumTaps - 1 - mDelay];
+    }
+
+    // the end of this block is the history for the next one
+    std::copy(input + numSamples, input + numSamples + mNumTaps, input);
+}
+
+void Oversampler::HalfBand::Down(const float* in, float* out, const int& numSamples) {
+    float* even = mEvenInput.data();
+    float* odd = mOddInput.data();
+
+    for(int sample = 0; sample < numSamples; ++sample) {
+        even[mNumTaps + sample] = in[2 * sample];
+        odd[mNumTaps + sample] = in[2 * sample + 1];
+    }
+
+    for(int sample = 0; sample < numSamples; ++sample)
+        out[sample] = Dot(even + sample + 1) + 0.5f * odd[sample + mNumTaps - 1 - mDelay];
+
+    std::copy(even + numSamples, even + numSamples + mNumTaps, even);
+    std::copy(odd + numSamples, odd + numSamples + mNumTaps, odd);
+}
+
+//                                  //                                      //
+
+void Oversampler::Prepare(const int& maximumBlockSize) {
+    RT_ASSERT_NOT_AUDIO_THREAD("Oversampler::Prepare() allocates");
+
+    // a pre-roll goes through in one pass, so it has to fit as well
+    const int size = std::max(maximumBlockSize, primeSamples);
+
+    // 91 and 23 taps. together they're flat to within 0.002 dB up to 0.43x the base
+    // rate (19 kHz at 44.1 kHz), and anything that would alias is at least 85 dB down
+    mStage1.Design(stage1Delay, 8.6, size);
+    mStage2.Design(stage2Delay, 8.6, size * 2);
+
+    mMaximumBlockSize = maximumBlockSize;
+    mBuffer2x.assign((size_t)size * 2, 0.0f);
+    mBuffer4x.assign((size_t)size * 4, 0.0f);
+
+    mPadInput.assign((size_t)(GetHistoryLength() + maximumBlockSize), 0.0f);
+    mPrerollOutput.assign((size_t)primeSamples, 0.0f);
+
+    Reset();
+}
+
+void Oversampler::Reset() {
+    ResetStages();
+    std::fill(mPadInput.begin(), mPadInput.end(), 0.0f);
+}
+
+void Oversampler::ResetStages() {
+    mStage1.Reset();
+    mStage2.Reset();
+    mAlignSample = 0.0f;
+}
+
+void Oversampler::SetFactor(const int& factor) {
+    mFactor = factor >= 4 ? 4 : (factor >= 2 ? 2 : 1);
+    ResetStages();
+}
+
+void Oversampler::SetLatency(const int& latency) {
+    const int padding = latency - GetLatency(mFactor),
+              history = GetLatency(4);
+
+    mPadding = padding < 0 ? 0 : (padding > history ? history : padding);
+}
+
+bool Oversampler::IsPassThrough() const {
+    return mFactor == 1 && mPadding == 0;
+}
+
+int Oversampler::GetFactor() const {
+    return mFactor;
+}
+
+int Oversampler::GetMaximumBlockSize() const {
+    return mMaximumBlockSize;
+}
+
+int Oversampler::GetHistoryLength() {
+    // the most that could ever be made up is the whole 4x latency
+    return GetLatency(4) + primeSamples;
+}
+
+float* Oversampler::Upsample(const float* in, const int& numSamples) {
+    // the input goes through its history even when it isn't delayed
+    const int history = GetHistoryLength();
+    float* padInput = mPadInput.data();
+    std::copy(in, in + numSamples, padInput + history);
+
+    float* out = UpsampleFrom(padInput + history - mPadding, numSamples);
+
+    std::copy(padInput + numSamples, padInput + numSamples + history, padInput);
+    return out;
+}
+
+void Oversampler::StoreInput(const float* in, const int& numSamples) {
+    const int history = GetHistoryLength();
+    float* padInput = mPadInput.data();
+
+    std::copy(in, in + numSamples, padInput + history);
+    std::copy(padInput + numSamples, padInput + numSamples + history, padInput);
+}
+
+float* Oversampler::UpsampleFrom(const float* source, const int& numSamples) {
+    float* out = mBuffer2x.data();
+
+    switch(mFactor) {
+        case 4:
+            mStage1.Up(source, mBuffer2x.data(), numSamples);
+            mStage2.Up(mBuffer2x.data(), mBuffer4x.data(), numSamples * 2);
+            out = mBuffer4x.data();
+            break;
+
+        case 2:
+            mStage1.Up(source, mBuffer2x.data(), numSamples);
+            break;
+
+        default:
+            std::copy(source, source + numSamples, mBuffer2x.data());
+            break;
+    }
+
+    return out;
+}
+
+void Oversampler::Downsample(float* out, const int& numSamples) {
+    switch(mFactor) {
+        case 4: {
+            float* buffer = mBuffer2x.data();
+            mStage2.Down(mBuffer4x.data(), buffer, numSamples * 2);
+
+            // one sample later at 2x
+            const float last = buffer[numSamples * 2 - 1];
+            std::copy_backward(buffer, buffer + numSamples * 2 - 1, buffer + numSamples * 2);
+            buffer[0] = mAlignSample;
+            mAlignSample = last;
+
+            mStage1.Down(buffer, out, numSamples);
+            break;
+        }
+
+        case 2:
+            mStage1.Down(mBuffer2x.data(), out, numSamples);
+            break;
+
+        default:
+            std::copy(mBuffer2x.data(), mBuffer2x.data() + numSamples, out);
+            break;
+    }
+}
+
+float* Oversampler::BeginPreroll() {
+    // ends just where the next block will start
+    const float* source = mPadInput.data() + GetHistoryLength() - mPadding - primeSamples;
+
+    ResetStages();
+    return UpsampleFrom(source, primeSamples);
+}
+
+void Oversampler::EndPreroll() {
+    Downsample(mPrerollOutput.data(), primeSamples);
+}
+
+void Oversampler::CopyInputFrom(const Oversampler& other) {
+    if(other.mPadInput.size() == mPadInput.size())
+        std::copy(other.mPadInput.begin(), other.mPadInput.end(), mPadInput.begin());
+}
+
+int Oversampler::GetLatency(const int& factor) {
+    // each stage delays by 2 * delay + 1 at its lower rate, there and back again,
+    // plus the extra sample at 2x that lines up the second stage
+    const int stage1 = 2 * stage1Delay + 1,
+              stage2 = (2 * stage2Delay + 1 + 1) / 2;
+
+    switch(factor) {
+        case 4:
+            return stage1 + stage2;
+        case 2:
+            return stage1;
+        default:
+            return 0;
+    }
+}
+
+int Oversampler::GetFactorIndex(const int& factor) {
+    return factor >= 4 ? 2 : (factor >= 2 ? 1 : 0);
+}
+
+int Oversampler::ChooseFactor(const double& freq, const int& sampleRate) {
+    constexpr int numPoints = 64;
+    constexpr double lowFreq = 20.0;
+
+    const double highFreq = sampleRate * 0.43 < 20000.0 ? sampleRate * 0.43 : 20000.0;
+
+    // the widest band the editor offers, at the largest boost and cut, against the
+    // same band designed so far above the audio range that it's as good as analogue
+    constexpr double q = 0.7, gains[] { 12.0, -12.0 };
+
+    for(const int factor : { 1, 2 }) {
+        double worst = 0.0;
+
+        for(const double gain : gains) {
+            Filter band, reference;
+            band.SetSampleRate(sampleRate * factor);
+            reference.SetSampleRate(sampleRate * 16);
+            band.SetParameters(Peak, freq, q, gain);
+            reference.SetParameters(Peak, freq, q, gain);
+
+            for(int i = 0; i < numPoints; ++i) {
+                const double f = lowFreq * pow(highFreq / lowFreq, (double)i / (numPoints - 1));
+                const double error = fabs(20.0 * log10(band.GetMagnitude(f) / reference.GetMagnitude(f)));
+                worst = error > worst ? error : worst;
+            }
+        }
+
+        if(worst <= toleranceDb)
+            return factor;
+    }
+
+    return 4;
+}
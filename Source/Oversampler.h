@@ -0,0 +1,146 @@
+// Declaration of the oversampler, which runs the filters at 2x or 4x the sample
+// rate. The bilinear transform squeezes a band's response towards Nyquist, so at
+// 44.1 or 48 kHz the 10 kHz band comes out several dB narrower on its upper side
+// than it should; designing and running the band at a multiple of the rate moves
+// Nyquist out of the way.
+//
+// Each 2x step is a polyphase half-band FIR. All the odd taps of a half-band filter
+// bar the centre one are zero, so one phase is a plain delay and only the other
+// needs a dot product, which is split across four accumulators so it compiles to
+// SIMD. The filters are linear phase, so the latency is a whole number of samples
+// and can be reported to the host. A lower factor can be delayed to the same latency
+// as a higher one, so the quality scheduler can drop a factor without the host's
+// latency compensation going wrong. A factor that's just been set can be primed
+// from the input's recent history (see BeginPreroll()), so it picks up where it
+// would have been rather than starting from silence.
+
+#pragma once
+#include <vector>
+
+class Oversampler {
+ private:
+    // one 2x step (both up and down), with the filtered phase's taps padded to a
+    // multiple of four
+    class HalfBand {
+     private:
+        static constexpr int maximumTaps = 48;
+
+        // the filtered phase, oldest sample first
+        float mCoefficients[maximumTaps] {};
+        int mNumTaps {}, mDelay {};
+
+        // the last numTaps input samples followed by the block being worked on, so
+        // every output reads one contiguous window (going round a ring instead means
+        // reading back samples that were only just stored, which stalls every sample)
+        std::vector<float> mUpInput, mEvenInput, mOddInput;
+
+        float Dot(const float* window) const;
+
+     public:
+        // a 4 * delay + 3 tap Kaiser-windowed half-band, which delays by
+        // 2 * delay + 1 samples at the higher rate each way. allocates
+        void Design(const int& delay, const double& beta, const int& maximumBlockSize);
+
+        void Reset();
+
+        // out takes twice as many samples as in
+        void Up(const float* in, float* out, const int& numSamples);
+
+        // in holds twice as many samples as out
+        void Down(const float* in, float* out, const int& numSamples);
+    };
+
+    HalfBand mStage1, mStage2;
+
+    int mFactor = 1, mMaximumBlockSize {};
+
+    std::vector<float> mBuffer2x, mBuffer4x;
+
+    // the second stage delays by a half sample at 2x, so one more sample there
+    // brings the 4x latency to a whole number at the base rate
+    float mAlignSample {};
+
+    // the input's recent history followed by the block, so it can be delayed to bring
+    // a lower factor's latency up to a higher one's (see SetLatency()), with another
+    // primeSamples before that for a pre-roll. it's kept up to date whatever the delay,
+    // so changing the factor doesn't jump back in time
+    std::vector<float> mPadInput;
+    int mPadding {};
+
+    // where a pre-roll's output goes, as nothing listens to it
+    std::vector<float> mPrerollOutput;
+
+    // clears the stages' history, but not the input's
+    void ResetStages();
+
+    // how much input is kept from before each block
+    static int GetHistoryLength();
+
+    // takes the samples at source up through the current factor's stages
+    float* UpsampleFrom(const float* source, const int& numSamples);
+
+ public:
+    // designs the stages and allocates, so never call this from the audio thread
+    void Prepare(const int& maximumBlockSize);
+
+    void Reset();
+
+    // 1, 2 or 4. clears the stages' history, so run a pre-roll before the next block
+    // wherever the output is heard
+    void SetFactor(const int& factor);
+    int GetFactor() const;
+
+    // holds the total latency at this many samples by delaying the input, so a lower
+    // factor can stand in for a higher one without the host's latency compensation
+    // going wrong. never less than the current factor's own, so call after SetFactor()
+    void SetLatency(const int& latency);
+
+    // factor 1 with nothing to delay, so the filters can run on the host's buffer
+    bool IsPassThrough() const;
+
+    // keeps the input's history up to date for a block that doesn't go through
+    // Upsample() (see IsPassThrough()), so a pre-roll has the right input to go on
+    void StoreInput(const float* in, const int& numSamples);
+
+    int GetMaximumBlockSize() const;
+
+    // returns numSamples * factor samples to be processed in place, then passed
+    // back through Downsample()
+    float* Upsample(const float* in, const int& numSamples);
+    void Downsample(float* out, const int& numSamples);
+
+    // runs the primeSamples of input just before the next block through the stages,
+    // so a factor (or latency) that's just been set starts with the history it would
+    // have had. returns primeSamples * factor samples for the filters, as Upsample()
+    // does, and EndPreroll() takes them back down and throws them away
+    float* BeginPreroll();
+    void EndPreroll();
+
+    // takes on another oversampler's input history, so it can take over from that
+    // one. both have to have been prepared with the same block size
+    void CopyInputFrom(const Oversampler& other);
+
+    // in samples at the base rate, for whichever factor is given
+    static int GetLatency(const int& factor);
+
+    // the factors there are, and where each one goes in anything kept per factor
+    // (see DualFilter::BandDesign)
+    static constexpr int numFactors = 3;
+    static int GetFactorIndex(const int& factor);
+
+    // the lowest factor that keeps a band at the given frequency within tolerance of
+    // its analogue response up to 20 kHz (or just short of the base Nyquist)
+    static int ChooseFactor(const double& freq, const int& sampleRate);
+
+    // half the smallest gain step an exercise asks to tell apart
+    static constexpr double toleranceDb = 0.5;
+
+    // each stage's delay parameter (see HalfBand::Design). 1x to 2x needs a steep
+    // filter to keep everything up to 20 kHz at 44.1 kHz, 2x to 4x only has to reject
+    // what's above the first stage's passband
+    static constexpr int stage1Delay = 22, stage2Delay = 5;
+
+    // the length of a pre-roll. the stages only remember about 110 samples between
+    // them (at the base rate), and the rest gives the filters time to settle
+    static constexpr int primeSamples = 128;
+};
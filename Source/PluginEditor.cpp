@@ -1,8 +1,9 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "Trace.h"
 
 RandomEQEditor::RandomEQEditor(RandomEQProcessor& p)
-                  : AudioProcessorEditor (&p), processorRef (p) {
+                  : AudioProcessorEditor (&p), processorRef (p), prefetcher (p) {
     juce::ignoreUnused (processorRef);
 
     // frequency options
@@ -86,49 +87,248 @@ RandomEQEditor::RandomEQEditor(RandomEQProcessor& p)
 
     addAndMakeVisible(&highQ);
 
+    // A/B toggle — only available once the band has been revealed
+    hearGuess.setToggleable(true);
+    hearGuess.setEnabled(false);
+    hearGuess.onClick = [&] { OnHearGuessClick(hearGuess.getToggleState()); };
+    hearGuess.setTooltip("After checking, switch between the real band and your guess");
+
+    addAndMakeVisible(&hearGuess);
+
+    // advanced exercise — the band only acts while the input is loud enough
+    dynamicBand.setToggleable(true);
+    dynamicBand.onClick = [&] { OnDynamicClick(dynamicBand.getToggleState()); };
+    dynamicBand.setTooltip("Advanced: the band only boosts or cuts while the input is above a threshold");
+
+    addAndMakeVisible(&dynamicBand);
+
+    // loops the last few seconds of input, so the band and the guess can be heard
+    // on exactly the same passage
+    replay.setToggleable(true);
+    replay.onClick = [&] { OnReplayClick(replay.getToggleState()); };
+    replay.setTooltip("Loop the last few seconds of input, instead of the live input");
+
+    addAndMakeVisible(&replay);
+
+    // keeps the high bands' shape at 44.1/48 kHz, at the cost of a little latency
+    oversample.setToggleable(true);
+    oversample.setToggleState(processorRef.GetOversampling(), NotificationType::dontSendNotification);
+    oversample.onClick = [&] { OnOversampleClick(oversample.getToggleState()); };
+    oversample.setTooltip("Run the filters at a higher sample rate, so bands near the top of the range keep their shape (adds a little latency)");
+
+    addAndMakeVisible(&oversample);
+
+    // level matching, so boosts can't be picked out by loudness alone
+    levelMatch.addItem("Level match: off", RandomEQProcessor::MatchOff);
+    levelMatch.addItem("Level match: metered", RandomEQProcessor::MatchMetered);
+    levelMatch.addItem("Level match: static", RandomEQProcessor::MatchStatic);
+    levelMatch.setSelectedId(processorRef.GetLoudnessMatch(), NotificationType::dontSendNotification);
+    levelMatch.onChange = [&] {
+        processorRef.SetLoudnessMatch((RandomEQProcessor::LoudnessMatch)levelMatch.getSelectedId());
+    };
+    levelMatch.setTooltip("Compensate the output level, either measured or estimated from the band");
+
+    addAndMakeVisible(&levelMatch);
+
+    // built-in test signals, for when there's no input device routed in
+    const bool isStandalone = processorRef.wrapperType == AudioProcessor::wrapperType_Standalone;
+
+    signalSource.addItem("Source: input", SignalGenerator::Input);
+    signalSource.addItem("Source: white noise", SignalGenerator::White);
+    signalSource.addItem("Source: pink noise", SignalGenerator::Pink);
+    signalSource.addItem("Source: brown noise", SignalGenerator::Brown);
+    signalSource.addItem("Source: log sweep", SignalGenerator::Sweep);
+    signalSource.addItem("Source: program noise", SignalGenerator::Program);
+    signalSource.setSelectedId(processorRef.GetSource(), NotificationType::dontSendNotification);
+    signalSource.onChange = [&] {
+        processorRef.SetSource((SignalGenerator::Source)signalSource.getSelectedId());
+    };
+
+    if(isStandalone)
+        addAndMakeVisible(&signalSource);
+
+   #if RANDOMEQ_TRACE
+    dumpTrace.onClick = [] {
+        const auto file = File::getSpecialLocation(File::userDesktopDirectory)
+            .getNonexistentChildFile("RandomEQ-trace", ".json");
+        Trace::WriteJson(file.getFullPathName().toStdString());
+    };
+    dumpTrace.setTooltip("Write recent trace events to the desktop, for chrome://tracing or Perfetto");
+
+    addAndMakeVisible(&dumpTrace);
+   #endif
+
+    // the processor carries on with the exercise from the last time an editor was
+    // open, so only the very first one draws a band
+    RestoreExercise();
+
+    bypassFilter.setToggleState(processorRef.GetBypass(), NotificationType::dontSendNotification);
+    dynamicBand.setToggleState(processorRef.GetDynamic(), NotificationType::dontSendNotification);
+    replay.setToggleState(processorRef.GetReplay(), NotificationType::dontSendNotification);
+
     // coefTime.setFont(13.0f);
     // coefTime.setJustificationType(Justification::centred);
     // coefTime.setTooltip("The time taken to calculate the new filter in nanoseconds");
     //
     // addAndMakeVisible(&coefTime);
 
-    setSize(500, 300);
+    setSize(500, 340);
 }
 
 RandomEQEditor::~RandomEQEditor() {
 }
 
+void RandomEQEditor::RestoreExercise() {
+    const auto& exercise = processorRef.GetExercise();
+
+    chosenFreq = exercise.chosenFreq;
+    chosenGain = exercise.chosenGain;
+    boostChosen = chosenGain > 0.0f;
+    revealed = exercise.revealed;
+    qMode = exercise.highQ ? ExercisePrefetcher::HighQ : ExercisePrefetcher::NormalQ;
+
+    // selections are set here rather than clicked on every resize
+    const std::pair<ToggleButton*, float> freqOptions[] {
+        { &freq125, 125.0f }, { &freq250, 250.0f }, { &freq500, 500.0f },
+        { &freq1k, 1000.0f }, { &freq3k, 3000.0f }, { &freq10k, 10000.0f }
+    };
+
+    const std::pair<ToggleButton*, float> gainOptions[] {
+        { &gain1, 1.0f }, { &gain3, 3.0f }, { &gain6, 6.0f }, { &gain12, 12.0f }
+    };
+
+    for(const auto& [button, freq] : freqOptions)
+        button->setToggleState(freq == chosenFreq, NotificationType::dontSendNotification);
+
+    for(const auto& [button, gain] : gainOptions)
+        button->setToggleState(gain == abs(chosenGain), NotificationType::dontSendNotification);
+
+    gainBoost.setToggleState(boostChosen, NotificationType::dontSendNotification);
+    gainCut.setToggleState(!boostChosen, NotificationType::dontSendNotification);
+    highQ.setToggleState(exercise.highQ, NotificationType::dontSendNotification);
+
+    if(!exercise.started) {
+        // the prefetch queue won't be ready yet, so the first band is designed here
+        processorRef.SetBand(DualFilter::Hidden, eqRandom.mType, eqRandom.mFreq,
+                             ExercisePrefetcher::qValues[qMode], eqRandom.mGain);
+        SaveExercise();
+        return;
+    }
+
+    eqRandom.mType = exercise.type;
+    eqRandom.mFreq = exercise.freq;
+    eqRandom.mGain = exercise.gain;
+
+    if(!revealed)
+        return;
+
+    // the processor still has the guess loaded, and whichever lane was playing
+    if(chosenFreq == eqRandom.mFreq && chosenGain == eqRandom.mGain)
+        OnParameterMatch();
+    else
+        OnParameterMismatch();
+
+    hearGuess.setEnabled(true);
+    hearGuess.setToggleState(processorRef.GetActiveLane() == DualFilter::Guess,
+                             NotificationType::dontSendNotification);
+    check.setButtonText("Next");
+}
+
+void RandomEQEditor::SaveExercise() {
+    RandomEQProcessor::ExerciseState exercise;
+
+    exercise.started = true;
+    exercise.type = eqRandom.mType;
+    exercise.freq = eqRandom.mFreq;
+    exercise.gain = eqRandom.mGain;
+    exercise.chosenFreq = chosenFreq;
+    exercise.chosenGain = chosenGain;
+    exercise.revealed = revealed;
+    exercise.highQ = qMode == ExercisePrefetcher::HighQ;
+
+    processorRef.SetExercise(exercise);
+}
+
 void RandomEQEditor::OnFreqClick(const float& freqVal) {
     chosenFreq = freqVal;
+    SaveExercise();
 }
 
 void RandomEQEditor::OnGainClick(const float& gainVal) {
-    chosenGain = gainVal;
+    chosenGain = boostChosen ? gainVal : -gainVal;
+    SaveExercise();
 }
 
 void RandomEQEditor::OnBoostCutClick(const bool& isBoost) {
     chosenGain = isBoost ? abs(chosenGain) : -abs(chosenGain);
     boostChosen = isBoost;
+    SaveExercise();
 }
 
 void RandomEQEditor::OnCheckClick(ToggleButton& freq, ToggleButton& gainBoostCut,
                                   ToggleButton& gain) {
+    TRACE_SCOPE("RandomEQEditor::OnCheckClick");
+
+    // the first click reveals the band and loads the guess alongside it for A/B,
+    // the second click moves on to a new band
+    if(!revealed) {
+        if(chosenFreq == eqRandom.mFreq && chosenGain == eqRandom.mGain)
+            OnParameterMatch();
+        else
+            OnParameterMismatch();
+
+        processorRef.SetBand(DualFilter::Guess, eqRandom.mType, chosenFreq,
+                             ExercisePrefetcher::qValues[qMode], chosenGain);
+
+        revealed = true;
+        SaveExercise();
+
+        hearGuess.setEnabled(true);
+        check.setButtonText("Next");
+
+        matchLabel.setBounds(250, getHeight() / 2 + 30, 250, 100);
+        return;
+    }
+
     freq.triggerClick();
     gainBoostCut.triggerClick();
     gain.triggerClick();
 
-    if(chosenFreq == eqRandom.mFreq && chosenGain == eqRandom.mGain)
-        OnParameterMatch();
-    else
-        OnParameterMismatch();
+    // the next exercise should already be waiting, with its band designed. the queue
+    // can't know which exercise is on screen, so skip one that would repeat it
+    ExercisePrefetcher::Exercise next;
+    bool ready = prefetcher.Pop(next);
+
+    if(ready && next.freq == eqRandom.mFreq && next.gain == eqRandom.mGain)
+        ready = prefetcher.Pop(next);
 
-    eqRandom.Randomise(0);
+    if(ready) {
+        eqRandom.mType = next.type;
+        eqRandom.mFreq = next.freq;
+        eqRandom.mGain = next.gain;
 
-    for(auto& channel : processorRef.filter)
-        channel.SetParameters(eqRandom.mType, eqRandom.mFreq,
-                              channel.mQ, eqRandom.mGain);
+        processorRef.SetBand(DualFilter::Hidden, next.band[qMode]);
+    }
+    else {
+        eqRandom.Randomise(0);
+
+        processorRef.SetBand(DualFilter::Hidden, eqRandom.mType, eqRandom.mFreq,
+                             ExercisePrefetcher::qValues[qMode], eqRandom.mGain);
+    }
+
+    processorRef.SetActiveLane(DualFilter::Hidden);
 
-    matchLabel.setBounds(250, getHeight() / 2 + 30, 250, 100);
+    revealed = false;
+    SaveExercise();
+
+    hearGuess.setToggleState(false, NotificationType::dontSendNotification);
+    hearGuess.setEnabled(false);
+    check.setButtonText("Check");
+
+    // the next exercise starts on the live input again
+    replay.setToggleState(false, NotificationType::dontSendNotification);
+    processorRef.SetReplay(false);
+    matchLabel.setText("Select parameters...", NotificationType::dontSendNotification);
 
     // int coefTimeMean = (processorRef.filter[0].GetCoefficientProcessTime() +
     //                     processorRef.filter[0].GetCoefficientProcessTime()) / 2;
@@ -139,18 +339,35 @@ void RandomEQEditor::OnCheckClick(ToggleButton& freq, ToggleButton& gainBoostCut
 }
 
 void RandomEQEditor::OnBypassClick(const bool& buttonState) {
-    for(auto& channel : processorRef.filter) {
-        channel.mEnabled = !buttonState;
-    }
+    processorRef.SetBypass(buttonState);
 }
 
 void RandomEQEditor::OnHighQClick(const bool& buttonState) {
-    for(auto& channel : processorRef.filter) {
-        channel.mQ = buttonState ? 3.5 : 0.7;
-    }
+    // applies from the next band onwards
+    qMode = buttonState ? ExercisePrefetcher::HighQ : ExercisePrefetcher::NormalQ;
+    SaveExercise();
+}
+
+void RandomEQEditor::OnHearGuessClick(const bool& buttonState) {
+    // no recalculation here, the lanes just crossfade
+    processorRef.SetActiveLane(buttonState ? DualFilter::Guess : DualFilter::Hidden);
+}
+
+void RandomEQEditor::OnDynamicClick(const bool& buttonState) {
+    processorRef.SetDynamic(buttonState);
+}
+
+void RandomEQEditor::OnReplayClick(const bool& buttonState) {
+    processorRef.SetReplay(buttonState);
+}
+
+void RandomEQEditor::OnOversampleClick(const bool& buttonState) {
+    processorRef.SetOversampling(buttonState);
 }
 
 void RandomEQEditor::paint(juce::Graphics& g) {
+    TRACE_SCOPE("RandomEQEditor::paint");
+
     // Fill the background with a solid colour
     g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
 
@@ -175,6 +392,12 @@ void RandomEQEditor::OnParameterMismatch() {
         case Peak:
             typeText = "peak";
             break;
+        case HighPass:
+            typeText = "high-pass";
+            break;
+        case LowPass:
+            typeText = "low-pass";
+            break;
     }
 
     String gainText = (eqRandom.mGain > 0 ? "+" : "") +
@@ -196,6 +419,8 @@ void RandomEQEditor::OnParameterMismatch() {
 }
 
 void RandomEQEditor::resized() {
+    TRACE_SCOPE("RandomEQEditor::resized");
+
     int gainXPos = 175;
     int buttonYSpace = 40;
 
@@ -221,16 +446,27 @@ void RandomEQEditor::resized() {
     gain6.setBounds(gainXPos, buttonYSpace * 4, 80, 30);
     gain12.setBounds(gainXPos, buttonYSpace * 5, 80, 30);
 
-    freq125.triggerClick();
-    gainBoost.triggerClick();
-    gain1.triggerClick();
-    highQ.triggerClick();
-
     check.setBounds(350, getHeight() / 2 - 15, 80, 30);
 
     bypassFilter.setBounds(350, buttonYSpace, 80, 30);
 
     highQ.setBounds(350, buttonYSpace * 2, 80, 30);
 
+    replay.setBounds(350, buttonYSpace * 3, 80, 30);
+
+    hearGuess.setBounds(gainXPos, buttonYSpace * 6, 100, 30);
+
+    levelMatch.setBounds(290, 8, 190, 24);
+
+    dynamicBand.setBounds(gainXPos, getHeight() - 37, 100, 30);
+
+    oversample.setBounds(30, getHeight() - 37, 110, 30);
+
+    signalSource.setBounds(290, getHeight() - 34, 190, 24);
+
+   #if RANDOMEQ_TRACE
+    dumpTrace.setBounds(30, getHeight() - 64, 100, 24);
+   #endif
+
     // coefTime.setBounds(getWidth() / 2 - 125, buttonYSpace * 6.65, 250, 30);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "PluginProcessor.h"
+#include "ExercisePrefetcher.h"
 #include "RandomParameters.h"
 
 using namespace juce;
@@ -34,20 +35,44 @@ class RandomEQEditor : public juce::AudioProcessorEditor {
 
     ToggleButton bypassFilter { "Bypass" };
     ToggleButton highQ { "High Q" };
+    ToggleButton hearGuess { "Hear guess" };
+    ToggleButton dynamicBand { "Dynamic" };
+    ToggleButton replay { "Replay" };
+    ToggleButton oversample { "Oversample" };
+
+    ComboBox levelMatch;
+
+    // only shown in the standalone build
+    ComboBox signalSource;
+
+   #if RANDOMEQ_TRACE
+    TextButton dumpTrace { "Dump trace" };
+   #endif
 
     // Label coefTime {{}, "Filter processed in ---ns"};
 
-    TooltipWindow ttw;
+    // one tooltip window (and its timer) shared by every open editor
+    SharedResourcePointer<TooltipWindow> tooltipWindow;
 
-    RandomParameters currentParameters { 0.0f, 0.0f, Peak };
+    // the next few exercises, randomised and designed in the background
+    ExercisePrefetcher prefetcher;
 
     void OnParameterMatch();
     void OnParameterMismatch();
 
+    // picks the exercise back up from the processor (or starts the first one), and
+    // hands it back whenever it changes
+    void RestoreExercise();
+    void SaveExercise();
+
     float chosenFreq {}, chosenGain;
     bool boostChosen = false;
 
-    static constexpr u_int8_t shelfChance = 15;
+    // true once "Check" has revealed the band, until "Next" picks a new one
+    bool revealed = false;
+
+    // Q used for the next band sent to the processor
+    ExercisePrefetcher::QMode qMode = ExercisePrefetcher::HighQ;
 
 public:
     explicit RandomEQEditor(RandomEQProcessor&);
@@ -74,6 +99,14 @@ public:
 
     void OnHighQClick(const bool&);
 
+    void OnHearGuessClick(const bool&);
+
+    void OnDynamicClick(const bool&);
+
+    void OnReplayClick(const bool&);
+
+    void OnOversampleClick(const bool&);
+
     RandomParameters eqRandom;
 };
 
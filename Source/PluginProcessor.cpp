@@ -1,5 +1,8 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "Trace.h"
+#include "RealtimeCheck.h"
+#include <chrono>
 
 RandomEQProcessor::RandomEQProcessor() : AudioProcessor(BusesProperties()
                      #if ! JucePlugin_IsMidiEffect
@@ -76,11 +79,59 @@ void RandomEQProcessor::changeProgramName(int index, const juce::String& newName
 void RandomEQProcessor::prepareToPlay(double sampleRate, int samplesPerBlock) {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
-    juce::ignoreUnused (samplesPerBlock);
+    baseSampleRate = (int)sampleRate;
 
-    for(auto& channel : filter) {
-        channel.SetSampleRate((int)sampleRate);
+    // a dynamic band works through the block a few samples at a time, so make sure
+    // its coarsest step fits even if the host's blocks are tiny
+    const int maximumStep = juce::jmax(samplesPerBlock, DynamicBand::updateInterval * 4);
+
+    for(int channel = 0; channel < channelCount; ++channel) {
+        oversampler[channel].Prepare(maximumStep);
+        fadingOversampler[channel].Prepare(maximumStep);
+    }
+
+    fadeBuffer.assign((size_t)maximumStep, 0.0f);
+    fadeRemaining = 0;
+
+    dynamicBand.SetSampleRate(baseSampleRate);
+
+    {
+        // anything still queued is older than the bands kept here, and may be for the
+        // old rate, so it's dropped and the latest bands are designed again instead.
+        // the audio thread isn't running, so this can stand in for it
+        const juce::ScopedLock lock(bandLock);
+        designRate.store(baseSampleRate);
+        bandFifo.finishedRead(bandFifo.getNumReady());
+
+        for(int lane = 0; lane < DualFilter::NumLanes; ++lane) {
+            requestedBand[lane] = DesignFor(requestedBand[lane], baseSampleRate);
+            appliedBand[lane] = requestedBand[lane];
+        }
     }
+
+    meter.SetSampleRate((int)sampleRate, samplesPerBlock);
+    generator.SetSampleRate((int)sampleRate);
+    // keeps what it's captured unless the rate has changed
+    if(replayStorage != nullptr)
+        replayStorage->Prepare((int)sampleRate, channelCount);
+
+    appliedReplay = false;
+
+    scheduler.Reset();
+    ApplyQualityTier(QualityScheduler::Full);
+
+    // sets the filters' rates and loads the bands (after the tier, which the factor
+    // depends on). the latency is for the highest band any exercise can use
+    oversamplingFactor = Oversampler::ChooseFactor(RandomParameters::GetHighestFrequency(),
+                                                   baseSampleRate);
+    ApplyOversampling(ChooseRunningFactor(), GetReportedLatency(), false);
+    setLatencySamples(appliedLatency);
+
+    dynamicBand.Reset();
+
+    // the meter has just been reset, so let the next block set everything up again
+    appliedLoudnessMatch = MatchOff;
+    mMakeupGain = 1.0f;
 }
 
 void RandomEQProcessor::releaseResources() {
@@ -113,8 +164,17 @@ bool RandomEQProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
 
 void RandomEQProcessor::processBlock(juce::AudioBuffer<float>& buffer,
                                      juce::MidiBuffer& midiMessages) {
+    // before anything's timed or checked, as the first block claims a trace ring
+    TRACE_PREPARE();
+    TRACE_SCOPE("processBlock");
+    RT_AUDIO_THREAD_SCOPE();
+
+    const auto blockStart = std::chrono::steady_clock::now();
+
     ignoreUnused(midiMessages);
 
+    ApplyPendingChanges();
+
     // Clear unused output channels if there are less input channels (avoids garbage data)
     for(auto i = getTotalNumInputChannels(); i < getTotalNumOutputChannels(); ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
@@ -125,14 +185,443 @@ void RandomEQProcessor::processBlock(juce::AudioBuffer<float>& buffer,
     Alternatively, you can process the samples with the channels
     interleaved by keeping the same state.
     */
-    for(int channel = 0; channel < buffer.getNumChannels(); ++channel) {
-        const auto inputData = buffer.getReadPointer(channel);
-        auto outputData = buffer.getWritePointer(channel);
+    const int numChannels = buffer.getNumChannels(),
+              numSamples = buffer.getNumSamples();
+
+    // internal test signals replace whatever came in on every channel
+    const SignalGenerator::Source currentSource = source.load();
+
+    if(currentSource != SignalGenerator::Input) {
+        generator.Generate(currentSource, buffer.getWritePointer(0), numSamples);
+
+        for(int channel = 1; channel < numChannels; ++channel)
+            buffer.copyFrom(channel, 0, buffer, 0, 0, numSamples);
+    }
+
+    // keeps a copy of the dry input, or swaps it for the passage being replayed
+    if(auto* replayBuffer = replay.load(std::memory_order_acquire))
+        replayBuffer->Process(buffer.getArrayOfWritePointers(), numChannels, numSamples);
+
+    const bool metered = appliedLoudnessMatch == MatchMetered,
+               metering = metered && !meterHeld;
+
+    // the input has to be metered before the filters overwrite it
+    if(metering)
+        meter.CaptureInput(buffer.getArrayOfReadPointers(), numChannels, numSamples);
+
+    // a dynamic band moves its coefficients every few samples, otherwise the block
+    // goes through in as few passes as the oversampler's buffers allow. they're empty
+    // until prepareToPlay(), and a block that comes before it goes through unfiltered
+    const int maximumStep = oversampler[0].GetMaximumBlockSize(),
+              step = appliedDynamic ? juce::jmin(dynamicStep, maximumStep) : maximumStep;
+
+    for(int start = 0; step > 0 && start < numSamples; start += step) {
+        const int count = numSamples - start < step ? numSamples - start : step;
+
+        if(appliedDynamic) {
+            const BiquadCoefficients& c = dynamicBand.Process(buffer.getArrayOfReadPointers(),
+                                                              numChannels, start, count);
+
+            for(auto& channel : filter)
+                channel.SetLaneCoefficients(DualFilter::Hidden, c);
+        }
+
+        for(int channel = 0; channel < numChannels; ++channel) {
+            auto data = buffer.getWritePointer(channel) + start;
+
+            if(fadeRemaining > 0) {
+                std::copy(data, data + count, fadeBuffer.data());
+                ProcessPath(fadingOversampler[channel], fadingFilter[channel], fadeBuffer.data(), count);
+            }
+
+            ProcessPath(oversampler[channel], filter[channel], data, count);
+
+            // a linear ramp from the old factor to the new one, carried across blocks
+            for(int sample = 0; sample < count && sample < fadeRemaining; ++sample) {
+                const float mix = (float)(fadeLength - fadeRemaining + sample) / (float)fadeLength;
+                data[sample] = fadeBuffer[(size_t)sample] + mix * (data[sample] - fadeBuffer[(size_t)sample]);
+            }
+        }
+
+        fadeRemaining = juce::jmax(0, fadeRemaining - count);
+    }
+
+    // static compensation is already folded into the filter coefficients
+    float makeupTarget = 1.0f;
+
+    // a held meter keeps its last makeup gain
+    if(metered) {
+        if(metering)
+            meter.ProcessOutput(buffer.getArrayOfReadPointers(), numChannels, numSamples);
+
+        makeupTarget = meter.GetMakeupGain();
+    }
+
+    // ramp across the block so the makeup gain never steps
+    if(mMakeupGain != 1.0f || makeupTarget != 1.0f) {
+        for(int channel = 0; channel < numChannels; ++channel)
+            buffer.applyGainRamp(channel, 0, numSamples, mMakeupGain, makeupTarget);
+    }
+
+    mMakeupGain = makeupTarget;
+
+    // the block's cost against its length in real time, which sets the next tier
+    const double blockSeconds = std::chrono::duration<double>
+        (std::chrono::steady_clock::now() - blockStart).count();
+    // (the rate prepareToPlay() was given, as not every host sets getSampleRate() first)
+    scheduler.Update(blockSeconds, baseSampleRate > 0 ? (double)numSamples / baseSampleRate : 0.0);
+}
+
+void RandomEQProcessor::ApplyPendingChanges() {
+    int start1, size1, start2, size2;
+    bandFifo.prepareToRead(bandFifo.getNumReady(), start1, size1, start2, size2);
+
+    // every band is designed before it's queued, so this is just copying
+    auto applyBand = [this](const BandChange& change) {
+        const DualFilter::BandDesign& band = change.band;
+
+        appliedBand[change.lane] = band;
+        LoadLane(change.lane);
+
+        if(change.lane == DualFilter::Hidden)
+            LoadDynamicBand();
+    };
+
+    for(int i = 0; i < size1; ++i)
+        applyBand(bandQueue[start1 + i]);
+    for(int i = 0; i < size2; ++i)
+        applyBand(bandQueue[start2 + i]);
+
+    bandFifo.finishedRead(size1 + size2);
+
+    const auto lane = (DualFilter::Lane)activeLane.load();
+    const bool enabled = !bypassed.load();
+
+    for(auto& channel : filter) {
+        channel.SetActiveLane(lane);
+        channel.mEnabled = enabled;
+    }
+
+    const bool isDynamic = dynamic.load();
+
+    if(isDynamic != appliedDynamic) {
+        // put the static band back, or start the detector from silence
+        if(!isDynamic)
+            LoadLane(DualFilter::Hidden);
+        else
+            dynamicBand.Reset();
+
+        appliedDynamic = isDynamic;
+    }
+
+    const LoudnessMatch mode = loudnessMatch.load();
+
+    if(mode != appliedLoudnessMatch) {
+        // the meter starts again from silence whenever it's switched back on
+        if(mode == MatchMetered)
+            meter.Reset();
+
+        appliedLoudnessMatch = mode;
+
+        // static makeup is folded into (or taken back out of) the coefficients
+        LoadLanes();
+        LoadDynamicBand();
+    }
+
+    const bool isReplaying = replaying.load();
+    auto* replayBuffer = replay.load(std::memory_order_acquire);
+
+    if(replayBuffer != nullptr && isReplaying != appliedReplay) {
+        replayBuffer->SetReplaying(isReplaying);
+        appliedReplay = isReplaying;
+    }
+
+    const QualityScheduler::Tier tier = scheduler.GetTier();
+
+    if(tier != appliedTier)
+        ApplyQualityTier(tier);
+
+    // after the bands and the tier, which both decide the factor. a change waits for
+    // the last one's crossfade to finish, and has nothing to fade from before
+    // prepareToPlay()
+    const int factor = ChooseRunningFactor(),
+              latency = GetReportedLatency();
+
+    if(fadeRemaining == 0 && (factor != appliedOversampling || latency != appliedLatency))
+        ApplyOversampling(factor, latency, !fadeBuffer.empty());
+}
+
+int RandomEQProcessor::ChooseRunningFactor() const {
+    if(!oversampling.load())
+        return 1;
+
+    // a band designed for another rate could ask for more than the latency allows
+    int factor = juce::jmin(appliedBand[DualFilter::Hidden].factor, oversamplingFactor);
+
+    if(appliedTier >= QualityScheduler::ReducedOversampling && factor > 1)
+        factor /= 2;
+
+    return factor;
+}
+
+int RandomEQProcessor::GetReportedLatency() const {
+    return Oversampler::GetLatency(oversampling.load() ? oversamplingFactor : 1);
+}
+
+void RandomEQProcessor::ApplyOversampling(const int& factor, const int& latency,
+                                          const bool& crossfade) {
+    // what's running moves over to fade out, state and all (swapping doesn't allocate),
+    // and the new factor takes over the input's history
+    if(crossfade) {
+        for(int channel = 0; channel < channelCount; ++channel) {
+            std::swap(oversampler[channel], fadingOversampler[channel]);
+            oversampler[channel].CopyInputFrom(fadingOversampler[channel]);
+
+            fadingFilter[channel] = filter[channel];
+            filter[channel].Reset();
+        }
+    }
+
+    // every band was designed for each factor up front, so the lanes just load the
+    // new factor's coefficients (the dynamic band's detector stays at the base rate)
+    for(auto& channel : oversampler) {
+        channel.SetFactor(factor);
+        channel.SetLatency(latency);
+    }
+
+    for(auto& channel : filter)
+        channel.SetSampleRate(baseSampleRate * factor);
+
+    appliedOversampling = factor;
+    appliedLatency = latency;
+    runningFactor = factor;
+
+    LoadLanes();
+    LoadDynamicBand();
+
+    if(!crossfade)
+        return;
+
+    // starting the new stages and filters from silence would drop the signal out for
+    // a millisecond or so, so they're run over the last few milliseconds of input first
+    for(int channel = 0; channel < channelCount; ++channel) {
+        float* upsampled = oversampler[channel].BeginPreroll();
+
+        for(int sample = 0; sample < Oversampler::primeSamples * factor; ++sample)
+            upsampled[sample] = filter[channel].Process(upsampled[sample]);
+
+        oversampler[channel].EndPreroll();
+    }
+
+    fadeLength = juce::jmax(1, (int)(oversamplingFadeMs * 0.001 * baseSampleRate));
+    fadeRemaining = fadeLength;
+}
+
+void RandomEQProcessor::ProcessPath(Oversampler& channelOversampler, DualFilter& channelFilter,
+                                    float* data, const int& numSamples) {
+    // the history still has to be kept for a pre-roll
+    if(channelOversampler.IsPassThrough()) {
+        channelOversampler.StoreInput(data, numSamples);
+
+        for(int sample = 0; sample < numSamples; ++sample)
+            data[sample] = channelFilter.Process(data[sample]);
 
-        for(int sample = 0; sample < buffer.getNumSamples(); ++sample)
-            outputData[sample] = filter[channel].Process(inputData[sample] * 0.2f) * 5.0f;
-        //                                                  may be redundant  ^       ^
+        return;
     }
+
+    // the filters run on the oversampled copy in place
+    float* upsampled = channelOversampler.Upsample(data, numSamples);
+    const int numUpsampled = numSamples * channelOversampler.GetFactor();
+
+    for(int sample = 0; sample < numUpsampled; ++sample)
+        upsampled[sample] = channelFilter.Process(upsampled[sample]);
+
+    channelOversampler.Downsample(data, numSamples);
+}
+
+void RandomEQProcessor::LoadLane(const DualFilter::Lane& lane) {
+    // while the dynamic mode is on, the hidden lane is overwritten every few samples
+    const BiquadCoefficients c = appliedBand[lane].GetCoefficients(appliedOversampling,
+                                                                  appliedLoudnessMatch == MatchStatic);
+
+    for(auto& channel : filter)
+        channel.SetLaneCoefficients(lane, c);
+}
+
+void RandomEQProcessor::LoadLanes() {
+    LoadLane(DualFilter::Hidden);
+    LoadLane(DualFilter::Guess);
+}
+
+void RandomEQProcessor::LoadDynamicBand() {
+    const DualFilter::BandDesign& band = appliedBand[DualFilter::Hidden];
+    const int index = Oversampler::GetFactorIndex(appliedOversampling);
+
+    dynamicBand.SetParameters(band.type, band.prewarp[index], band.q, band.gain,
+                              appliedLoudnessMatch == MatchStatic ? band.makeupGain[index] : 1.0);
+}
+
+void RandomEQProcessor::ApplyQualityTier(const QualityScheduler::Tier& tier) {
+    // none of these can click: the meter carries its measurement across a rate
+    // change (and a held meter holds its gain), and the dynamic band just takes
+    // bigger steps
+    meter.SetReducedRate(tier >= QualityScheduler::ReducedMetering);
+
+    dynamicStep = tier >= QualityScheduler::CoarseDynamics
+        ? DynamicBand::updateInterval * 4 : DynamicBand::updateInterval;
+
+    meterHeld = tier >= QualityScheduler::MeterHeld;
+
+    // ReducedOversampling is picked up with the oversampling setting, just after this,
+    // and crossfades into the lower factor (see ApplyOversampling())
+    appliedTier = tier;
+}
+
+bool RandomEQProcessor::SetBand(const DualFilter::Lane& lane, const FilterType& type,
+                                const double& freq, const double& q, const double& gain) {
+    RT_ASSERT_NOT_AUDIO_THREAD("RandomEQProcessor::SetBand() designs and locks");
+
+    // held while designing, so prepareToPlay() can't change the rate in between
+    const juce::ScopedLock lock(bandLock);
+    return QueueBand(lane, DualFilter::Design(type, freq, q, gain, designRate.load(),
+                                              loudnessMatch.load() == MatchStatic));
+}
+
+bool RandomEQProcessor::SetBand(const DualFilter::Lane& lane, const DualFilter::BandDesign& band) {
+    RT_ASSERT_NOT_AUDIO_THREAD("RandomEQProcessor::SetBand() designs and locks");
+
+    const juce::ScopedLock lock(bandLock);
+    return QueueBand(lane, DesignFor(band, designRate.load()));
+}
+
+bool RandomEQProcessor::QueueBand(const DualFilter::Lane& lane, const DualFilter::BandDesign& band) {
+    int start1, size1, start2, size2;
+    bandFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if(size1 + size2 < 1) {
+        jassertfalse;
+        return false;
+    }
+
+    bandQueue[size1 > 0 ? start1 : start2] = { lane, band };
+    bandFifo.finishedWrite(1);
+
+    requestedBand[lane] = band;
+    return true;
+}
+
+DualFilter::BandDesign RandomEQProcessor::DesignFor(const DualFilter::BandDesign& band,
+                                                    const int& rate) const {
+    const bool withMakeup = loudnessMatch.load() == MatchStatic;
+
+    if(band.sampleRate == rate && (band.hasMakeup || !withMakeup))
+        return band;
+
+    return DualFilter::Design(band.type, band.freq, band.q, band.gain, rate, withMakeup);
+}
+
+int RandomEQProcessor::GetDesignRate() const {
+    return designRate.load();
+}
+
+void RandomEQProcessor::SetActiveLane(const DualFilter::Lane& lane) {
+    activeLane = lane;
+}
+
+DualFilter::Lane RandomEQProcessor::GetActiveLane() const {
+    return (DualFilter::Lane)activeLane.load();
+}
+
+void RandomEQProcessor::SetBypass(const bool& shouldBypass) {
+    bypassed = shouldBypass;
+}
+
+bool RandomEQProcessor::GetBypass() const {
+    return bypassed;
+}
+
+void RandomEQProcessor::SetDynamic(const bool& shouldBeDynamic) {
+    dynamic = shouldBeDynamic;
+}
+
+bool RandomEQProcessor::GetDynamic() const {
+    return dynamic;
+}
+
+void RandomEQProcessor::SetLoudnessMatch(const LoudnessMatch& mode) {
+    RT_ASSERT_NOT_AUDIO_THREAD("RandomEQProcessor::SetLoudnessMatch() designs and locks");
+
+    const juce::ScopedLock lock(bandLock);
+    const int rate = designRate.load();
+
+    // the bands go ahead of the mode, so the audio thread has them by the time it sees
+    // it (bar a single block, if it reads the queue just before they're added)
+    if(mode == MatchStatic && rate > 0) {
+        for(int lane = 0; lane < DualFilter::NumLanes; ++lane) {
+            const DualFilter::BandDesign& band = requestedBand[lane];
+
+            if(!band.hasMakeup)
+                QueueBand((DualFilter::Lane)lane, DualFilter::Design(band.type, band.freq, band.q,
+                                                                     band.gain, rate, true));
+        }
+    }
+
+    loudnessMatch = mode;
+}
+
+RandomEQProcessor::LoudnessMatch RandomEQProcessor::GetLoudnessMatch() const {
+    return loudnessMatch;
+}
+
+void RandomEQProcessor::SetSource(const SignalGenerator::Source& newSource) {
+    source = newSource;
+}
+
+SignalGenerator::Source RandomEQProcessor::GetSource() const {
+    return source;
+}
+
+void RandomEQProcessor::SetReplay(const bool& shouldReplay) {
+    replaying = shouldReplay;
+}
+
+bool RandomEQProcessor::GetReplay() const {
+    return replaying;
+}
+
+void RandomEQProcessor::SetExercise(const ExerciseState& state) {
+    exercise = state;
+}
+
+const RandomEQProcessor::ExerciseState& RandomEQProcessor::GetExercise() const {
+    return exercise;
+}
+
+void RandomEQProcessor::SetOversampling(const bool& shouldOversample) {
+    oversampling = shouldOversample;
+
+    // the audio thread catches up at its next block
+    setLatencySamples(GetReportedLatency());
+}
+
+bool RandomEQProcessor::GetOversampling() const {
+    return oversampling;
+}
+
+int RandomEQProcessor::GetRunningFactor() const {
+    return runningFactor;
+}
+
+void RandomEQProcessor::SetCpuBudget(const float& fraction) {
+    scheduler.SetBudget(fraction);
+}
+
+QualityScheduler::Tier RandomEQProcessor::GetQualityTier() const {
+    return scheduler.GetTier();
+}
+
+float RandomEQProcessor::GetCpuLoad() const {
+    return scheduler.GetLoad();
 }
 
 //                                    //                                    //
@@ -142,9 +631,23 @@ bool RandomEQProcessor::hasEditor() const {
 }
 
 juce::AudioProcessorEditor* RandomEQProcessor::createEditor() {
+    EnsureReplayBuffer();
     return new RandomEQEditor(*this);
 }
 
+void RandomEQProcessor::EnsureReplayBuffer() {
+    if(replayStorage != nullptr)
+        return;
+
+    // if there's no sample rate yet, prepareToPlay() will get to it before any audio runs
+    auto storage = std::make_unique<ReplayBuffer>();
+    if(getSampleRate() > 0.0)
+        storage->Prepare((int)getSampleRate(), channelCount);
+
+    replayStorage = std::move(storage);
+    replay.store(replayStorage.get(), std::memory_order_release);
+}
+
 //                                    //                                    //
 
 void RandomEQProcessor::getStateInformation(juce::MemoryBlock& destData) {
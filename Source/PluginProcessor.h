@@ -1,6 +1,12 @@
 #pragma once
 #include <juce_audio_processors/juce_audio_processors.h>
-#include "Filter.h"
+#include "DualFilter.h"
+#include "DynamicBand.h"
+#include "LoudnessMeter.h"
+#include "Oversampler.h"
+#include "QualityScheduler.h"
+#include "ReplayBuffer.h"
+#include "SignalGenerator.h"
 #include "RandomParameters.h"
 
 class RandomEQProcessor : public juce::AudioProcessor {
@@ -9,6 +15,116 @@ class RandomEQProcessor : public juce::AudioProcessor {
 
     static constexpr int channelCount = 2;
 
+    // each channel runs the hidden band and the user's guess side-by-side
+    DualFilter filter[channelCount];
+
+    // runs the filters at a multiple of the sample rate, so the high bands keep their
+    // shape. the factor is whatever the hidden band needs, and the guess shares it
+    Oversampler oversampler[channelCount];
+
+    // when the factor or the latency changes, the filters and oversamplers that were
+    // running carry on here while the output crossfades into the new ones, which start
+    // from a pre-roll of the input's recent history (see ApplyOversampling())
+    DualFilter fadingFilter[channelCount];
+    Oversampler fadingOversampler[channelCount];
+
+    // the fading path's copy of the channel being worked on
+    std::vector<float> fadeBuffer;
+
+    // samples left in the crossfade, and its length
+    int fadeRemaining {}, fadeLength {};
+
+    static constexpr double oversamplingFadeMs = 10.0;
+
+    // one channel's samples through an oversampler and its filters, in place
+    static void ProcessPath(Oversampler&, DualFilter&, float* data, const int& numSamples);
+
+    // oversamplingFactor is the most any exercise's band can need, worked out in
+    // prepareToPlay(). the latency is always its, since that's what the host was told,
+    // and a lower factor is padded out to it (see Oversampler::SetLatency())
+    int baseSampleRate {}, oversamplingFactor = 1, appliedOversampling = 1, appliedLatency {};
+
+    // the hidden band's factor (or 1 if oversampling is off), a step lower when the CPU
+    // is short (see QualityScheduler::ReducedOversampling). so it changes with the
+    // exercise as well, and each change crossfades (see ApplyOversampling())
+    int ChooseRunningFactor() const;
+    int GetReportedLatency() const;
+
+    // the host's rate, for designing bands on other threads
+    std::atomic<int> designRate { 0 };
+
+    // crossfades from the current factor unless told not to, which is only for when
+    // nothing's been heard yet
+    void ApplyOversampling(const int& factor, const int& latency, const bool& crossfade);
+
+    LoudnessMeter meter;
+
+    // makeup gain applied at the end of the last block
+    float mMakeupGain = 1.0f;
+
+    SignalGenerator generator;
+
+    // the last few seconds of dry input, for replaying the exercise passage. at a
+    // few MB each, it's only allocated once an editor has been opened (a session
+    // full of instances mostly never needs one), then handed to the audio thread
+    std::unique_ptr<ReplayBuffer> replayStorage;
+    std::atomic<ReplayBuffer*> replay { nullptr };
+
+    // called from the message thread
+    void EnsureReplayBuffer();
+
+    // band changes from the editor, designed before they're queued for the audio
+    // thread to pick up
+    struct BandChange {
+        DualFilter::Lane lane;
+        DualFilter::BandDesign band;
+    };
+
+    static constexpr int bandQueueSize = 16;
+    BandChange bandQueue[bandQueueSize];
+    juce::AbstractFifo bandFifo { bandQueueSize };
+
+    // the last band queued for each lane, so prepareToPlay() can design them again
+    // for a new rate. guarded by bandLock, which the audio thread never takes
+    DualFilter::BandDesign requestedBand[DualFilter::NumLanes];
+    juce::CriticalSection bandLock;
+
+    // queues a band and keeps it as the lane's latest, with bandLock held
+    bool QueueBand(const DualFilter::Lane& lane, const DualFilter::BandDesign& band);
+
+    // the band as it should be designed at this rate: the same one, or designed again
+    // if it's for another rate, or it's missing the static makeup the match mode needs.
+    // with bandLock held, so the mode can't change in between
+    DualFilter::BandDesign DesignFor(const DualFilter::BandDesign& band, const int& rate) const;
+
+    // the audio thread's copy of each lane's band, kept so the lanes can be loaded
+    // again for another oversampling factor, or with or without static makeup
+    DualFilter::BandDesign appliedBand[DualFilter::NumLanes];
+
+    // copies a lane's coefficients (for the current factor) into every channel
+    void LoadLane(const DualFilter::Lane& lane);
+    void LoadLanes();
+
+    // drives the hidden lane's gain while the dynamic mode is on
+    DynamicBand dynamicBand;
+
+    // gives the dynamic band the hidden band (for the current factor), along with its
+    // static makeup when that's the match mode
+    void LoadDynamicBand();
+
+    // steps quality down (or back up) when blocks take too long against their deadline
+    QualityScheduler scheduler;
+    QualityScheduler::Tier appliedTier = QualityScheduler::Full;
+
+    // what the current tier allows
+    int dynamicStep = DynamicBand::updateInterval;
+    bool meterHeld = false;
+
+    void ApplyQualityTier(const QualityScheduler::Tier&);
+
+    // called at the start of each block, so the editor never touches audio state
+    void ApplyPendingChanges();
+
  public:
     RandomEQProcessor();
     ~RandomEQProcessor() override;
@@ -48,5 +164,105 @@ class RandomEQProcessor : public juce::AudioProcessor {
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
-    Filter filter[channelCount];
+    //                                  //                                  //
+
+    // everything below is called from the message thread, and only takes effect
+    // at the start of the next block
+
+    // designs the band on the calling thread, so the audio thread only has to copy
+    // it in. returns false if the queue is full (the change is dropped)
+    bool SetBand(const DualFilter::Lane& lane, const FilterType& type,
+                 const double& freq, const double& q, const double& gain);
+
+    // for a band designed ahead of time (see ExercisePrefetcher). it's designed again
+    // here if the sample rate or the match mode has changed since
+    bool SetBand(const DualFilter::Lane& lane, const DualFilter::BandDesign& band);
+
+    // the rate bands should be designed for, which is the host's (each design covers
+    // every oversampling factor). 0 until the processor has been prepared, and safe
+    // to call from any thread
+    int GetDesignRate() const;
+
+    void SetActiveLane(const DualFilter::Lane&);
+    DualFilter::Lane GetActiveLane() const;
+
+    void SetBypass(const bool&);
+    bool GetBypass() const;
+
+    // the hidden band only boosts/cuts while the input is above a threshold
+    void SetDynamic(const bool&);
+    bool GetDynamic() const;
+
+    // how the output is matched to the level of the input (also the combo box IDs)
+    enum LoudnessMatch {
+        MatchOff = 1,
+        MatchMetered,
+        MatchStatic
+    };
+
+    // switching to MatchStatic designs the latest bands again with their makeup, since
+    // it's only worked out when that's the mode
+    void SetLoudnessMatch(const LoudnessMatch&);
+    LoudnessMatch GetLoudnessMatch() const;
+
+    // replaces the input with an internal test signal (Input uses the real input)
+    void SetSource(const SignalGenerator::Source&);
+    SignalGenerator::Source GetSource() const;
+
+    // loops the passage that was just heard in place of the input (through whichever
+    // lane is active), until it's switched off again
+    void SetReplay(const bool&);
+    bool GetReplay() const;
+
+    // the exercise on screen, kept here so that closing and reopening the editor
+    // carries on with it instead of drawing a new band. message thread only
+    struct ExerciseState {
+        // false until an editor has drawn the first band
+        bool started = false;
+
+        FilterType type = Peak;
+        float freq {}, gain {};
+
+        // the user's guess, and whether "Check" has revealed the band yet
+        float chosenFreq = 125.0f, chosenGain = 1.0f;
+        bool revealed = false, highQ = true;
+    };
+
+    void SetExercise(const ExerciseState&);
+    const ExerciseState& GetExercise() const;
+
+    // runs the filters oversampled (at whichever factor suits the sample rate), and
+    // reports the latency that adds to the host straight away
+    void SetOversampling(const bool&);
+    bool GetOversampling() const;
+
+    // the factor the filters are running at (see ChooseRunningFactor()), as of the
+    // last block. safe to call from any thread
+    int GetRunningFactor() const;
+
+    // the share of each block's deadline the processor may use before quality steps down
+    void SetCpuBudget(const float& fraction);
+
+    QualityScheduler::Tier GetQualityTier() const;
+
+    // smoothed processing time as a fraction of the block deadline
+    float GetCpuLoad() const;
+
+ private:
+    std::atomic<int> activeLane { DualFilter::Hidden };
+    std::atomic<bool> bypassed { false };
+    std::atomic<bool> dynamic { false };
+    std::atomic<bool> replaying { false };
+    std::atomic<bool> oversampling { false };
+    std::atomic<int> runningFactor { 1 };
+
+    std::atomic<LoudnessMatch> loudnessMatch { MatchMetered };
+    std::atomic<SignalGenerator::Source> source { SignalGenerator::Input };
+
+    ExerciseState exercise;
+
+    // what the audio thread last applied, so changes can be detected
+    LoudnessMatch appliedLoudnessMatch = MatchOff;
+    bool appliedDynamic = false;
+    bool appliedReplay = false;
 };
@@ -0,0 +1,70 @@
+// Implementation of the adaptive quality scheduler
+
+#include "QualityScheduler.h"
+#include "Trace.h"
+#include <cmath>
+
+void QualityScheduler::Reset() {
+    mTier = Full;
+    mLoad = 0.0;
+    mSinceChange = mRecoveringFor = 0.0;
+
+    mPublishedTier.store(Full, std::memory_order_relaxed);
+    mPublishedLoad.store(0.0f, std::memory_order_relaxed);
+}
+
+void QualityScheduler::SetBudget(const float& fraction) {
+    mBudget.store(fraction > 0.0f ? fraction : defaultBudget, std::memory_order_relaxed);
+}
+
+QualityScheduler::Tier QualityScheduler::Update(const double& blockSeconds,
+                                                const double& deadlineSeconds) {
+    if(deadlineSeconds <= 0.0)
+        return mTier;
+
+    // a single slow block (a page fault, say) shouldn't cost any quality on its own,
+    // so the load is smoothed over a few blocks
+    const double load = blockSeconds / deadlineSeconds;
+    const double time = load > mLoad ? attackSeconds : releaseSeconds;
+    mLoad += (1.0 - exp(-deadlineSeconds / time)) * (load - mLoad);
+
+    mSinceChange += deadlineSeconds;
+
+    const double budget = mBudget.load(std::memory_order_relaxed);
+
+    if(mLoad > budget) {
+        mRecoveringFor = 0.0;
+
+        // give the last step a chance to take effect before going further
+        if(mTier < NumTiers - 1 && mSinceChange >= stepDownHoldSeconds) {
+            mTier = (Tier)(mTier + 1);
+            mSinceChange = 0.0;
+        }
+    }
+    else if(mLoad < budget * stepUpRatio) {
+        mRecoveringFor += deadlineSeconds;
+
+        if(mTier > Full && mRecoveringFor >= stepUpHoldSeconds) {
+            mTier = (Tier)(mTier - 1);
+            mSinceChange = mRecoveringFor = 0.0;
+        }
+    }
+    else
+        mRecoveringFor = 0.0;
+
+    mPublishedTier.store(mTier, std::memory_order_relaxed);
+    mPublishedLoad.store((float)mLoad, std::memory_order_relaxed);
+
+    TRACE_COUNTER("cpu load", mLoad);
+    TRACE_COUNTER("quality tier", mTier);
+
+    return mTier;
+}
+
+QualityScheduler::Tier QualityScheduler::GetTier() const {
+    return (Tier)mPublishedTier.load(std::memory_order_relaxed);
+}
+
+float QualityScheduler::GetLoad() const {
+    return mPublishedLoad.load(std::memory_order_relaxed);
+}
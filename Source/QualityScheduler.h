@@ -0,0 +1,70 @@
+// Declaration of the adaptive quality scheduler. Each block's processing time is
+// compared against its deadline (the block's length in real time), and when the
+// smoothed load goes over the budget, quality steps down a tier at a time rather
+// than letting the block run late and drop out. Quality only steps back up once
+// the load has stayed well under the budget for a while, so it doesn't flap.
+//
+// The tiers are ordered by how audible they are, and none of them click as they
+// switch (see RandomEQProcessor::ApplyQualityTier). The smoothed load and the
+// current tier are also recorded as trace counters, for tuning the thresholds.
+
+#pragma once
+#include <atomic>
+
+class QualityScheduler {
+ public:
+    enum Tier {
+        Full = 0,
+        // the loudness meter runs at half its usual rate, where that still leaves room
+        // for the weighting (see LoudnessMeter::minimumReducedMeterRate). from 44.1 kHz
+        // up it's already as low as it goes, and this tier leaves it there
+        ReducedMetering,
+        // the dynamic band updates its coefficients less often
+        CoarseDynamics,
+        // the loudness meter stops, and the makeup gain holds where it was
+        MeterHeld,
+        // the filters run at half the oversampling factor, which roughly halves their
+        // cost. the top bands lose a little of their shape, and both factors run for the
+        // crossfade between them, so it's the last resort
+        ReducedOversampling,
+        NumTiers
+    };
+
+ private:
+    // set from the message thread, as a fraction of the block deadline
+    std::atomic<float> mBudget { defaultBudget };
+
+    // published for other threads
+    std::atomic<int> mPublishedTier { Full };
+    std::atomic<float> mPublishedLoad { 0.0f };
+
+    Tier mTier = Full;
+    double mLoad {};
+
+    // time since the last tier change, and how long the load has been low
+    double mSinceChange {}, mRecoveringFor {};
+
+ public:
+    void Reset();
+
+    // how much of the block deadline the processor may use
+    void SetBudget(const float& fraction);
+
+    // called at the end of each block, returns the tier for the next one
+    Tier Update(const double& blockSeconds, const double& deadlineSeconds);
+
+    // safe to call from any thread
+    Tier GetTier() const;
+    float GetLoad() const;
+
+    static constexpr float defaultBudget = 0.2f;
+
+    // the load has to fall below this much of the budget before quality steps back up
+    static constexpr double stepUpRatio = 0.6;
+
+    // how quickly the smoothed load follows rises and falls
+    static constexpr double attackSeconds = 0.05, releaseSeconds = 0.5;
+
+    // shortest time between steps down, and how long the load must stay low to step up
+    static constexpr double stepDownHoldSeconds = 0.1, stepUpHoldSeconds = 2.0;
+};
@@ -1,14 +1,12 @@
 // Implementation of the random EQ parameter class, including a Lehmer RNG
 
 #include "RandomParameters.h"
+#include <algorithm>
+#include <iterator>
+#include <random>
 
 RandomParameters::RandomParameters() {
     InitialiseSeed();
-
-    // TODO user-customisable options would be great:
-    mGainOptionsDb = {1.0f, 3.0f, 6.0f, 12.0f};
-    mFreqOptionsHz = {125.0f, 250.0f, 500.0f, 1000.0f, 3000.0f, 10000.0f};
-
     Randomise();
 }
 
@@ -23,25 +21,26 @@ bool RandomParameters::operator==(const RandomParameters& rhs) const {
 //                                  //                                      //
 
 // a modified version of a lehmer RNG — quick, high-quality random numbers
-u_int32_t RandomParameters::Random() {
+uint32_t RandomParameters::Random() {
     mLehmerSeed += 0xe120fc15;
-    u_int64_t tmp;
-    tmp = (u_int64_t)mLehmerSeed * 0x4a39b70d;
-    u_int32_t m1 = (tmp >> 32) ^ tmp;
-    tmp = (u_int64_t)m1 * 0x12fad5c9;
+    uint64_t tmp;
+    tmp = (uint64_t)mLehmerSeed * 0x4a39b70d;
+    uint32_t m1 = (tmp >> 32) ^ tmp;
+    tmp = (uint64_t)m1 * 0x12fad5c9;
     return (tmp >> 32) ^ tmp;
 }
 
 // above, but returns within a range (inclusive) for cleaner expressions
-u_int32_t RandomParameters::RandomRange(const u_int32_t& min, const u_int32_t& max) {
+uint32_t RandomParameters::RandomRange(const uint32_t& min, const uint32_t& max) {
     return (Random() % (max - min + 1)) + min;
 }
 
-// use the current system time in milliseconds to produce a pseudorandom seed
-// needed to set the lehmer seed to something random upon construction
+// needed to set the lehmer seed to something random upon construction. the system
+// time isn't enough, since the editor and the prefetcher build theirs in the same
+// millisecond, and would then draw the same exercises
 void RandomParameters::InitialiseSeed() {
-    mLehmerSeed = std::chrono::time_point_cast<std::chrono::milliseconds>
-        (std::chrono::system_clock::now()).time_since_epoch().count();
+    std::random_device device;
+    mLehmerSeed = (uint32_t)device();
 }
 
 void RandomParameters::DetermineType() {
@@ -55,7 +54,7 @@ void RandomParameters::DetermineType() {
         this->mType = Peak;
 }
 
-void RandomParameters::Randomise(const u_int8_t& shelfChance) {
+void RandomParameters::Randomise(const uint8_t& shelfChance) {
     mShelfChance = shelfChance > 100 ? 100 : shelfChance;
 
     if(useRandomOther) {
@@ -71,10 +70,14 @@ void RandomParameters::Randomise(const u_int8_t& shelfChance) {
     RandomiseParameters();
 }
 
+float RandomParameters::GetHighestFrequency() {
+    return *std::max_element(std::begin(mFreqOptionsHz), std::end(mFreqOptionsHz));
+}
+
 void RandomParameters::RandomiseParameters() {
     float gainPolarity = RandomRange(0, 1) == 1 ? 1.0f : -1.0f;
 
-    this->mGain = mGainOptionsDb[Random() % mGainOptionsDb.size()] * gainPolarity;
-    this->mFreq = mFreqOptionsHz[Random() % mFreqOptionsHz.size()];
+    this->mGain = mGainOptionsDb[Random() % std::size(mGainOptionsDb)] * gainPolarity;
+    this->mFreq = mFreqOptionsHz[Random() % std::size(mFreqOptionsHz)];
     DetermineType();
 }
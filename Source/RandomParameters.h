@@ -5,18 +5,15 @@
 
 #pragma once
 #include "Filter.h"
-
-using u_int8_t = unsigned char;
-using u_int32_t = unsigned int;
-using u_int64_t = unsigned long long;
+#include <cstdint>
 
 class RandomParameters {
  private:
-    u_int32_t mLehmerSeed {};
+    uint32_t mLehmerSeed {};
 
-    u_int32_t Random();
+    uint32_t Random();
 
-    u_int32_t RandomRange(const u_int32_t&, const u_int32_t&);
+    uint32_t RandomRange(const uint32_t&, const uint32_t&);
 
     void RandomiseParameters();
 
@@ -24,10 +21,13 @@ class RandomParameters {
 
     void DetermineType();
 
-    std::vector<float> mGainOptionsDb, mFreqOptionsHz;
+    // TODO user-customisable options would be great
+    // (shared by every instance for now, rather than allocated by each one)
+    static constexpr float mGainOptionsDb[] { 1.0f, 3.0f, 6.0f, 12.0f },
+                           mFreqOptionsHz[] { 125.0f, 250.0f, 500.0f, 1000.0f, 3000.0f, 10000.0f };
 
-    static constexpr u_int8_t mDefaultShelfChance = 10;
-    u_int8_t mShelfChance {};
+    static constexpr uint8_t mDefaultShelfChance = 10;
+    uint8_t mShelfChance {};
 
  public:
     float mGain {}, mFreq {};
@@ -39,7 +39,10 @@ class RandomParameters {
 
     bool operator==(const RandomParameters&) const;
 
-    void Randomise(const u_int8_t& shelfChance = mDefaultShelfChance);
+    void Randomise(const uint8_t& shelfChance = mDefaultShelfChance);
+
+    // the highest band frequency an exercise can pick
+    static float GetHighestFrequency();
 
     bool useRandomOther = true;
 
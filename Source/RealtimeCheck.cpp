@@ -0,0 +1,154 @@
+// Implementation of the audio thread checks, including the operator new/delete
+// replacements that catch allocations made while processing
+
+#include "RealtimeCheck.h"
+
+#if RANDOMEQ_RT_CHECK
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local bool isAudioThread = false;
+
+    std::atomic<int> violationCount { 0 };
+    std::atomic<const char*> lastViolation { nullptr };
+
+    void* Allocate(std::size_t size) {
+        if(isAudioThread)
+            RealtimeCheck::ReportViolation("allocation on the audio thread");
+
+        return std::malloc(size > 0 ? size : 1);
+    }
+
+    void* AllocateAligned(std::size_t size, std::align_val_t alignment) {
+        if(isAudioThread)
+            RealtimeCheck::ReportViolation("allocation on the audio thread");
+
+       #if defined(_WIN32)
+        return _aligned_malloc(size > 0 ? size : 1, (std::size_t)alignment);
+       #else
+        void* ptr = nullptr;
+        const std::size_t align = (std::size_t)alignment < sizeof(void*)
+            ? sizeof(void*) : (std::size_t)alignment;
+        return posix_memalign(&ptr, align, size > 0 ? size : 1) == 0 ? ptr : nullptr;
+       #endif
+    }
+
+    void Deallocate(void* ptr) {
+        if(ptr != nullptr && isAudioThread)
+            RealtimeCheck::ReportViolation("deallocation on the audio thread");
+
+        std::free(ptr);
+    }
+
+    void DeallocateAligned(void* ptr) {
+        if(ptr != nullptr && isAudioThread)
+            RealtimeCheck::ReportViolation("deallocation on the audio thread");
+
+       #if defined(_WIN32)
+        _aligned_free(ptr);
+       #else
+        std::free(ptr);
+       #endif
+    }
+}
+
+RealtimeCheck::AudioThreadScope::AudioThreadScope() : mWasAudioThread(isAudioThread) {
+    isAudioThread = true;
+}
+
+RealtimeCheck::AudioThreadScope::~AudioThreadScope() {
+    isAudioThread = mWasAudioThread;
+}
+
+bool RealtimeCheck::IsAudioThread() {
+    return isAudioThread;
+}
+
+void RealtimeCheck::ReportViolation(const char* what) {
+    // must not allocate, as it's called from inside operator new
+    lastViolation.store(what);
+    violationCount.fetch_add(1);
+}
+
+void RealtimeCheck::CheckNotAudioThread(const char* what) {
+    if(isAudioThread)
+        ReportViolation(what);
+}
+
+int RealtimeCheck::GetViolationCount() {
+    return violationCount.load();
+}
+
+const char* RealtimeCheck::GetLastViolation() {
+    return lastViolation.load();
+}
+
+void RealtimeCheck::ResetViolations() {
+    violationCount.store(0);
+    lastViolation.store(nullptr);
+}
+
+//                                  //                                      //
+
+void* operator new(std::size_t size) {
+    if(void* ptr = Allocate(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    if(void* ptr = Allocate(size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if(void* ptr = AllocateAligned(size, alignment))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    if(void* ptr = AllocateAligned(size, alignment))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { DeallocateAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { DeallocateAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { DeallocateAligned(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { DeallocateAligned(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { DeallocateAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { DeallocateAligned(ptr); }
+
+#endif
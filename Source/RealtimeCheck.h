@@ -0,0 +1,59 @@
+// Checks that the audio thread stays allocation- and lock-free.
+//
+// With RANDOMEQ_RT_CHECK=1 (on by default in Debug builds), processBlock() marks
+// its thread as the audio thread for the duration of the block. The global
+// operator new/delete are replaced, so any allocation or deallocation made from
+// inside the block is counted as a violation. Locks and system calls can't be
+// intercepted portably, so functions that may lock, block or allocate (sample
+// rate changes, file writes, etc.) instead assert they're never called from it.
+// Nothing here stops the audio thread when it finds one: the real-time test
+// (RealtimeTest.cpp) drives the blocks, intercepts malloc() and the lock and
+// system call entry points where it can, and reports whatever was counted.
+// Without the flag, the macros expand to nothing.
+
+#pragma once
+
+#if RANDOMEQ_RT_CHECK
+
+namespace RealtimeCheck {
+    // marks the current thread as the audio thread while in scope
+    class AudioThreadScope {
+     private:
+        bool mWasAudioThread;
+
+     public:
+        AudioThreadScope();
+        ~AudioThreadScope();
+
+        AudioThreadScope(const AudioThreadScope&) = delete;
+        AudioThreadScope& operator=(const AudioThreadScope&) = delete;
+    };
+
+    bool IsAudioThread();
+
+    // records a violation, wherever it's called from (what must be a literal). it
+    // doesn't allocate or lock, so it's safe inside an allocator or lock wrapper
+    void ReportViolation(const char* what);
+
+    // records a violation if called from the audio thread
+    void CheckNotAudioThread(const char* what);
+
+    int GetViolationCount();
+
+    // a description of the most recent violation, or nullptr if there hasn't been one
+    const char* GetLastViolation();
+
+    void ResetViolations();
+}
+
+#define RT_CONCAT_INNER(a, b) a##b
+#define RT_CONCAT(a, b) RT_CONCAT_INNER(a, b)
+#define RT_AUDIO_THREAD_SCOPE() RealtimeCheck::AudioThreadScope RT_CONCAT(rtScope_, __LINE__)
+#define RT_ASSERT_NOT_AUDIO_THREAD(what) RealtimeCheck::CheckNotAudioThread(what)
+
+#else
+
+#define RT_AUDIO_THREAD_SCOPE()
+#define RT_ASSERT_NOT_AUDIO_THREAD(what)
+
+#endif
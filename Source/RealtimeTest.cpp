@@ -0,0 +1,596 @@
+// Real-time safety test. Drives processBlock() through every supported bus layout,
+// a few sample rates and a spread of block sizes, stepping through every parameter
+// transition along the way, then runs blocks on an audio thread while the editor
+// is opened, clicked through and closed again on the message thread. Fails if
+// anything inside a block allocates, frees, locks, waits or makes a blocking
+// system call. Built only with RANDOMEQ_BUILD_TESTS, and run by ctest (see
+// CMakeLists.txt)
+//
+// usage: RandomEQRealtimeTest [--seconds=2]
+//
+// operator new/delete are caught by RealtimeCheck. With glibc, this executable also
+// replaces malloc() and friends and the pthread, sleep and I/O entry points, so
+// whatever JUCE or the C library does underneath is caught too. Elsewhere, only
+// operator new/delete and the RT_ASSERT_NOT_AUDIO_THREAD() checks are covered
+
+// the C library's fortified inline wrappers would clash with the replacements below
+#undef _FORTIFY_SOURCE
+
+#include "PluginProcessor.h"
+#include "RealtimeCheck.h"
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if ! RANDOMEQ_RT_CHECK
+ #error "the real-time test needs RANDOMEQ_RT_CHECK=1"
+#endif
+
+#if defined(__GLIBC__)
+ #include <atomic>
+ #include <cerrno>
+ #include <cstdarg>
+ #include <dlfcn.h>
+ #include <fcntl.h>
+ #include <poll.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <semaphore.h>
+ #include <sys/select.h>
+ #include <time.h>
+ #include <unistd.h>
+
+//                                  //                                      //
+
+// everything below replaces the C library's own, and checks which thread it's on
+// before passing the call on. the allocator goes straight to glibc's internal
+// entry points, as looking anything up could allocate
+
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void __libc_free(void*);
+}
+
+namespace {
+    void Check(const char* what) {
+        if(RealtimeCheck::IsAudioThread())
+            RealtimeCheck::ReportViolation(what);
+    }
+
+    // the next definition along (the C library's), looked up the first time it's
+    // needed. Resolve() looks everything up before any audio runs
+    template <typename Function>
+    Function Next(std::atomic<void*>& cache, const char* name) {
+        void* function = cache.load(std::memory_order_relaxed);
+
+        if(function == nullptr) {
+            function = dlsym(RTLD_NEXT, name);
+            cache.store(function, std::memory_order_relaxed);
+        }
+
+        return (Function)function;
+    }
+
+    #define RT_NEXT(name) Next<decltype(&name)>(name##Next, #name)
+
+    std::atomic<void*> pthread_mutex_lockNext, pthread_mutex_trylockNext,
+                       pthread_rwlock_rdlockNext, pthread_rwlock_wrlockNext,
+                       pthread_spin_lockNext, pthread_cond_waitNext, pthread_cond_timedwaitNext,
+                       pthread_joinNext, sem_waitNext, sem_timedwaitNext,
+                       nanosleepNext, clock_nanosleepNext, usleepNext, sleepNext, sched_yieldNext,
+                       readNext, writeNext, openNext, closeNext, fopenNext, fwriteNext, fflushNext,
+                       pollNext, selectNext;
+
+    void Resolve() {
+        RT_NEXT(pthread_mutex_lock); RT_NEXT(pthread_mutex_trylock);
+        RT_NEXT(pthread_rwlock_rdlock); RT_NEXT(pthread_rwlock_wrlock);
+        RT_NEXT(pthread_spin_lock); RT_NEXT(pthread_cond_wait); RT_NEXT(pthread_cond_timedwait);
+        RT_NEXT(pthread_join); RT_NEXT(sem_wait); RT_NEXT(sem_timedwait);
+        RT_NEXT(nanosleep); RT_NEXT(clock_nanosleep); RT_NEXT(usleep); RT_NEXT(sleep);
+        RT_NEXT(sched_yield);
+        RT_NEXT(read); RT_NEXT(write); RT_NEXT(open); RT_NEXT(close);
+        RT_NEXT(fopen); RT_NEXT(fwrite); RT_NEXT(fflush);
+        RT_NEXT(poll); RT_NEXT(select);
+    }
+
+    constexpr bool interposed = true;
+}
+
+extern "C" {
+    void* malloc(size_t size) {
+        Check("malloc() on the audio thread");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        Check("calloc() on the audio thread");
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size) {
+        Check("realloc() on the audio thread");
+        return __libc_realloc(ptr, size);
+    }
+
+    void free(void* ptr) {
+        if(ptr != nullptr)
+            Check("free() on the audio thread");
+
+        __libc_free(ptr);
+    }
+
+    void* memalign(size_t alignment, size_t size) {
+        Check("memalign() on the audio thread");
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        Check("aligned_alloc() on the audio thread");
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** ptr, size_t alignment, size_t size) {
+        Check("posix_memalign() on the audio thread");
+
+        if(alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        void* result = __libc_memalign(alignment, size);
+        if(result == nullptr)
+            return ENOMEM;
+
+        *ptr = result;
+        return 0;
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex) {
+        Check("pthread_mutex_lock() on the audio thread");
+        return RT_NEXT(pthread_mutex_lock)(mutex);
+    }
+
+    int pthread_mutex_trylock(pthread_mutex_t* mutex) {
+        Check("pthread_mutex_trylock() on the audio thread");
+        return RT_NEXT(pthread_mutex_trylock)(mutex);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock) {
+        Check("pthread_rwlock_rdlock() on the audio thread");
+        return RT_NEXT(pthread_rwlock_rdlock)(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock) {
+        Check("pthread_rwlock_wrlock() on the audio thread");
+        return RT_NEXT(pthread_rwlock_wrlock)(lock);
+    }
+
+    int pthread_spin_lock(pthread_spinlock_t* lock) {
+        Check("pthread_spin_lock() on the audio thread");
+        return RT_NEXT(pthread_spin_lock)(lock);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex) {
+        Check("pthread_cond_wait() on the audio thread");
+        return RT_NEXT(pthread_cond_wait)(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex,
+                               const struct timespec* time) {
+        Check("pthread_cond_timedwait() on the audio thread");
+        return RT_NEXT(pthread_cond_timedwait)(condition, mutex, time);
+    }
+
+    int pthread_join(pthread_t thread, void** result) {
+        Check("pthread_join() on the audio thread");
+        return RT_NEXT(pthread_join)(thread, result);
+    }
+
+    int sem_wait(sem_t* semaphore) {
+        Check("sem_wait() on the audio thread");
+        return RT_NEXT(sem_wait)(semaphore);
+    }
+
+    int sem_timedwait(sem_t* semaphore, const struct timespec* time) {
+        Check("sem_timedwait() on the audio thread");
+        return RT_NEXT(sem_timedwait)(semaphore, time);
+    }
+
+    int nanosleep(const struct timespec* time, struct timespec* remaining) {
+        Check("nanosleep() on the audio thread");
+        return RT_NEXT(nanosleep)(time, remaining);
+    }
+
+    int clock_nanosleep(clockid_t clock, int flags, const struct timespec* time,
+                        struct timespec* remaining) {
+        Check("clock_nanosleep() on the audio thread");
+        return RT_NEXT(clock_nanosleep)(clock, flags, time, remaining);
+    }
+
+    int usleep(useconds_t microseconds) {
+        Check("usleep() on the audio thread");
+        return RT_NEXT(usleep)(microseconds);
+    }
+
+    unsigned int sleep(unsigned int seconds) {
+        Check("sleep() on the audio thread");
+        return RT_NEXT(sleep)(seconds);
+    }
+
+    int sched_yield() {
+        Check("sched_yield() on the audio thread");
+        return RT_NEXT(sched_yield)();
+    }
+
+    ssize_t read(int fd, void* buffer, size_t size) {
+        Check("read() on the audio thread");
+        return RT_NEXT(read)(fd, buffer, size);
+    }
+
+    ssize_t write(int fd, const void* buffer, size_t size) {
+        Check("write() on the audio thread");
+        return RT_NEXT(write)(fd, buffer, size);
+    }
+
+    int open(const char* path, int flags, ...) {
+        Check("open() on the audio thread");
+
+        // the mode is only passed when a file might be created
+        mode_t mode = 0;
+
+        if((flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE) {
+            va_list args;
+            va_start(args, flags);
+            mode = (mode_t)va_arg(args, int);
+            va_end(args);
+        }
+
+        return RT_NEXT(open)(path, flags, mode);
+    }
+
+    int close(int fd) {
+        Check("close() on the audio thread");
+        return RT_NEXT(close)(fd);
+    }
+
+    FILE* fopen(const char* path, const char* mode) {
+        Check("fopen() on the audio thread");
+        return RT_NEXT(fopen)(path, mode);
+    }
+
+    size_t fwrite(const void* buffer, size_t size, size_t count, FILE* file) {
+        Check("fwrite() on the audio thread");
+        return RT_NEXT(fwrite)(buffer, size, count, file);
+    }
+
+    int fflush(FILE* file) {
+        Check("fflush() on the audio thread");
+        return RT_NEXT(fflush)(file);
+    }
+
+    int poll(struct pollfd* fds, nfds_t numFds, int timeout) {
+        Check("poll() on the audio thread");
+        return RT_NEXT(poll)(fds, numFds, timeout);
+    }
+
+    int select(int numFds, fd_set* readFds, fd_set* writeFds, fd_set* exceptFds,
+               struct timeval* timeout) {
+        Check("select() on the audio thread");
+        return RT_NEXT(select)(numFds, readFds, writeFds, exceptFds, timeout);
+    }
+}
+
+#else
+
+namespace {
+    void Resolve() {}
+
+    constexpr bool interposed = false;
+}
+
+#endif
+
+//                                  //                                      //
+
+namespace {
+
+// host-like block sizes, including ones that don't divide into anything
+constexpr int blockSizes[] { 512, 1, 7, 64, 511, 33, 256, 128, 2, 480 };
+constexpr int maximumBlockSize = 512;
+
+class Test {
+ public:
+    explicit Test(const int& numChannels) : mInput(numChannels, maximumBlockSize) {}
+
+    // runs a few blocks of varying sizes on the calling thread, and reports anything
+    // the audio thread did that it shouldn't have, against what led up to it
+    void Run(RandomEQProcessor& processor, const char* step, const int& numBlocks = 8) {
+        for(int block = 0; block < numBlocks; ++block)
+            RunBlock(processor);
+
+        Report(step);
+    }
+
+    // one block, with fresh noise as its input
+    void RunBlock(RandomEQProcessor& processor) {
+        const int numSamples = blockSizes[mBlock++ % std::size(blockSizes)];
+
+        // the buffer's storage is allocated once up front, so this only moves its size
+        mBuffer.setDataToReferTo(mInput.getArrayOfWritePointers(), mInput.getNumChannels(), numSamples);
+
+        for(int channel = 0; channel < mBuffer.getNumChannels(); ++channel) {
+            float* data = mBuffer.getWritePointer(channel);
+
+            for(int sample = 0; sample < numSamples; ++sample)
+                data[sample] = mNoise(mRandom) * 0.25f;
+        }
+
+        processor.processBlock(mBuffer, mMidi);
+    }
+
+    void Report(const char* step) {
+        const int violations = RealtimeCheck::GetViolationCount();
+
+        if(violations > 0) {
+            std::printf("FAIL  %s: %d violation(s), the last was %s\n", step, violations,
+                        RealtimeCheck::GetLastViolation());
+            ++mFailures;
+        }
+
+        RealtimeCheck::ResetViolations();
+    }
+
+    int GetFailures() const { return mFailures; }
+
+ private:
+    juce::AudioBuffer<float> mInput, mBuffer;
+    juce::MidiBuffer mMidi;
+
+    std::minstd_rand mRandom { 1 };
+    std::uniform_real_distribution<float> mNoise { -1.0f, 1.0f };
+
+    size_t mBlock {};
+    int mFailures {};
+};
+
+std::unique_ptr<RandomEQProcessor> CreateProcessor(const juce::AudioChannelSet& layout,
+                                                   const int& sampleRate) {
+    auto processor = std::make_unique<RandomEQProcessor>();
+
+    juce::AudioProcessor::BusesLayout buses;
+    buses.inputBuses.add(layout);
+    buses.outputBuses.add(layout);
+
+    if(!processor->setBusesLayout(buses))
+        return nullptr;
+
+    processor->setRateAndBufferSizeDetails(sampleRate, maximumBlockSize);
+    processor->prepareToPlay(sampleRate, maximumBlockSize);
+    return processor;
+}
+
+// opens an editor (which is also what allocates the replay buffer) and closes it again
+void OpenAndCloseEditor(RandomEQProcessor& processor) {
+    std::unique_ptr<juce::AudioProcessorEditor> editor(processor.createEditorIfNeeded());
+}
+
+// every parameter transition, one at a time, for one bus layout and rate
+int RunTransitions(const juce::AudioChannelSet& layout, const int& sampleRate) {
+    auto processor = CreateProcessor(layout, sampleRate);
+
+    if(processor == nullptr) {
+        std::printf("FAIL  %s at %d Hz: layout not supported\n",
+                    layout.getDescription().toRawUTF8(), sampleRate);
+        return 1;
+    }
+
+    Test test(layout.size());
+    RandomEQProcessor& p = *processor;
+
+    test.Run(p, "first blocks");
+
+    for(const FilterType type : { LowShelf, HighShelf, Peak, HighPass, LowPass }) {
+        p.SetBand(DualFilter::Hidden, type, 3000.0, 3.5, 6.0);
+        p.SetBand(DualFilter::Guess, type, 250.0, 0.7, -12.0);
+        test.Run(p, "band changes");
+    }
+
+    // a band designed for another rate is designed again before it's queued
+    p.SetBand(DualFilter::Hidden, DualFilter::Design(Peak, 1000.0, 0.7, 3.0, sampleRate / 2, false));
+    test.Run(p, "band designed for another rate");
+
+    p.SetActiveLane(DualFilter::Guess);
+    test.Run(p, "hear the guess");
+    p.SetActiveLane(DualFilter::Hidden);
+    test.Run(p, "hear the hidden band");
+
+    p.SetBypass(true);
+    test.Run(p, "bypass on");
+    p.SetBypass(false);
+    test.Run(p, "bypass off");
+
+    for(const auto mode : { RandomEQProcessor::MatchOff, RandomEQProcessor::MatchStatic,
+                            RandomEQProcessor::MatchMetered, RandomEQProcessor::MatchStatic }) {
+        p.SetLoudnessMatch(mode);
+        test.Run(p, "loudness match change");
+    }
+
+    p.SetDynamic(true);
+    test.Run(p, "dynamic on");
+    p.SetBand(DualFilter::Hidden, Peak, 500.0, 0.7, 12.0);
+    test.Run(p, "band change while dynamic");
+    p.SetDynamic(false);
+    test.Run(p, "dynamic off");
+    p.SetLoudnessMatch(RandomEQProcessor::MatchMetered);
+
+    for(const auto source : { SignalGenerator::White, SignalGenerator::Pink, SignalGenerator::Brown,
+                              SignalGenerator::Sweep, SignalGenerator::Program, SignalGenerator::Input }) {
+        p.SetSource(source);
+        test.Run(p, "signal source change");
+    }
+
+    OpenAndCloseEditor(p);
+    test.Run(p, "after the editor closed");
+    p.SetReplay(true);
+    test.Run(p, "replay on", 64);
+    p.SetReplay(false);
+    test.Run(p, "replay off");
+
+    p.SetOversampling(!p.GetOversampling());
+    test.Run(p, "oversampling toggled");
+    p.SetBand(DualFilter::Hidden, Peak, 10000.0, 0.7, -6.0);
+    test.Run(p, "band change while oversampling is toggled");
+    p.SetOversampling(!p.GetOversampling());
+    test.Run(p, "oversampling toggled back");
+
+    // an impossible budget steps down through every tier, and a generous one comes
+    // back up again (slowly, on purpose). oversampling's on, so the last tier has a
+    // factor to drop
+    const bool wasOversampling = p.GetOversampling();
+    p.SetOversampling(true);
+    p.SetDynamic(true);
+    p.SetCpuBudget(1e-6f);
+
+    for(int block = 0; block < 4096 && p.GetQualityTier() != QualityScheduler::NumTiers - 1; ++block)
+        test.RunBlock(p);
+
+    test.Report("quality stepping down");
+    p.SetCpuBudget(1e6f);
+
+    for(int block = 0; block < 16384 && p.GetQualityTier() != QualityScheduler::Full; ++block)
+        test.RunBlock(p);
+
+    test.Report("quality stepping back up");
+    p.SetDynamic(false);
+    p.SetOversampling(wasOversampling);
+
+    // the host changes the rate between blocks
+    p.releaseResources();
+    p.setRateAndBufferSizeDetails(sampleRate * 2, maximumBlockSize);
+    p.prepareToPlay(sampleRate * 2, maximumBlockSize);
+    test.Run(p, "after a sample rate change");
+
+    return test.GetFailures();
+}
+
+// blocks run flat out on an audio thread, while the message thread opens editors,
+// clicks everything in them and changes parameters behind their backs
+int RunEditorStress(const double& seconds) {
+    auto processor = CreateProcessor(juce::AudioChannelSet::stereo(), 48000);
+    RandomEQProcessor& p = *processor;
+
+    std::atomic<bool> stop { false };
+    std::atomic<int> failures { 0 };
+
+    std::thread audioThread([&] {
+        Test test(2);
+
+        while(!stop.load())
+            test.Run(p, "blocks during editor stress", 16);
+
+        failures.store(test.GetFailures());
+    });
+
+    std::minstd_rand random { 2 };
+    std::unique_ptr<juce::AudioProcessorEditor> editor;
+
+    const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    int rounds = 0;
+
+    while(std::chrono::steady_clock::now() < end) {
+        if(editor == nullptr)
+            editor.reset(p.createEditorIfNeeded());
+
+        // everything clickable, in whatever order
+        for(auto* child : editor->getChildren()) {
+            if(random() % 2 != 0)
+                continue;
+
+            if(auto* button = dynamic_cast<juce::Button*>(child)) {
+                // writes a file, which isn't what's being tested
+                if(button->getButtonText() == "Dump trace")
+                    continue;
+
+                if(button->getClickingTogglesState())
+                    button->setToggleState(!button->getToggleState(), juce::dontSendNotification);
+
+                if(button->onClick != nullptr)
+                    button->onClick();
+            }
+            else if(auto* box = dynamic_cast<juce::ComboBox*>(child)) {
+                if(box->getNumItems() > 0)
+                    box->setSelectedItemIndex((int)(random() % (unsigned)box->getNumItems()),
+                                              juce::dontSendNotification);
+
+                if(box->onChange != nullptr)
+                    box->onChange();
+            }
+        }
+
+        // and the same from outside the editor, as a host's automation might
+        p.SetBand(DualFilter::Guess, (FilterType)(LowShelf + random() % 5),
+                  20.0 * std::pow(1000.0, (double)(random() % 1000) / 1000.0), 0.7,
+                  12.0 - (double)(random() % 25));
+        p.SetCpuBudget(random() % 4 == 0 ? 1e-6f : QualityScheduler::defaultBudget);
+
+        // closing the editor stops its prefetcher thread, and reopening it starts another
+        if(random() % 8 == 0)
+            editor.reset();
+
+        ++rounds;
+
+        // still far quicker than anyone clicks, but leaves the audio thread time to
+        // take the bands off the queue (which holds 16)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    editor.reset();
+    stop.store(true);
+    audioThread.join();
+
+    std::printf("      editor stress: %d rounds of clicks in %.1f s\n", rounds, seconds);
+    return failures.load();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Resolve();
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    const double seconds = args.containsOption("--seconds")
+                         ? juce::jmax(0.1, args.getValueForOption("--seconds").getDoubleValue()) : 2.0;
+
+    std::printf("RandomEQ real-time test (%s)\n\n", interposed
+        ? "allocations, locks, waits and blocking system calls"
+        : "operator new/delete and RT_ASSERT_NOT_AUDIO_THREAD() only");
+
+    // anything before now was setting up, not processing
+    RealtimeCheck::ResetViolations();
+
+    int failures = 0;
+
+    for(const auto& layout : { juce::AudioChannelSet::mono(), juce::AudioChannelSet::stereo() }) {
+        for(const int sampleRate : { 44100, 48000, 96000 }) {
+            const int layoutFailures = RunTransitions(layout, sampleRate);
+
+            std::printf("%s  %s at %d Hz\n", layoutFailures == 0 ? "ok  " : "FAIL",
+                        layout.getDescription().toRawUTF8(), sampleRate);
+            failures += layoutFailures;
+        }
+    }
+
+    const int stressFailures = RunEditorStress(seconds);
+    std::printf("%s  editor stress\n", stressFailures == 0 ? "ok  " : "FAIL");
+    failures += stressFailures;
+
+    std::printf("\n%s\n", failures == 0 ? "passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+// Implementation of the replay buffer used to re-audition the exercise passage
+
+#include "ReplayBuffer.h"
+#include "RealtimeCheck.h"
+#include <cmath>
+#include <cstring>
+
+void ReplayBuffer::Prepare(const int& sampleRate, const int& numChannels) {
+    RT_ASSERT_NOT_AUDIO_THREAD("ReplayBuffer::Prepare() allocates");
+
+    // clearing a few MB on every prepare would cost time and throw the capture away
+    if(sampleRate == mSampleRate && numChannels == mNumChannels)
+        return;
+
+    mSampleRate = sampleRate;
+    mNumChannels = numChannels;
+    mCapacity = (int)(maximumSeconds * sampleRate);
+    mStorage.assign((size_t)(mCapacity * numChannels), 0.0f);
+
+    const int fadeSamples = (int)(fadeTimeMs * 0.001 * sampleRate);
+    mFadeSamples = fadeSamples > 1 ? fadeSamples : 1;
+    mMixStep = 1.0f / (float)mFadeSamples;
+
+    Reset();
+}
+
+void ReplayBuffer::Reset() {
+    mWritePosition = mFilled = 0;
+    mPassageStart = mPassageLength = mPassagePosition = 0;
+    mLoopLength = mSeamSamples = 0;
+    mLooped = false;
+    mMix = mMixTarget = 0.0f;
+}
+
+void ReplayBuffer::SetReplaying(const bool& shouldReplay) {
+    const float target = shouldReplay && mFilled > 0 ? 1.0f : 0.0f;
+
+    // the passage is taken from whatever was captured up to now
+    if(target > 0.0f && mMixTarget == 0.0f && mMix == 0.0f)
+        StartPassage();
+
+    mMixTarget = target;
+}
+
+bool ReplayBuffer::IsReplaying() const {
+    return mMixTarget > 0.0f || mMix > 0.0f;
+}
+
+void ReplayBuffer::StartPassage() {
+    mPassageLength = mFilled;
+    mPassageStart = mWritePosition - mFilled;
+    if(mPassageStart < 0)
+        mPassageStart += mCapacity;
+
+    mPassagePosition = 0;
+
+    // a passage too short for a whole fade gives up half of itself to the seam
+    mSeamSamples = mFadeSamples < mPassageLength / 2 ? mFadeSamples : mPassageLength / 2;
+    mLoopLength = mPassageLength - mSeamSamples;
+    mLooped = false;
+}
+
+void ReplayBuffer::Capture(const float* const* channels, const int& numChannels,
+                           const int& numSamples) {
+    // only the most recent part of a block longer than the ring can be kept
+    const int count = numSamples < mCapacity ? numSamples : mCapacity,
+              offset = numSamples - count;
+
+    const int first = mCapacity - mWritePosition < count ? mCapacity - mWritePosition : count,
+              second = count - first;
+
+    for(int channel = 0; channel < mNumChannels; ++channel) {
+        // fewer input channels than the ring has, so repeat the last one
+        const float* in = channels[channel < numChannels ? channel : numChannels - 1] + offset;
+        float* ring = mStorage.data() + (size_t)(channel * mCapacity);
+
+        std::memcpy(ring + mWritePosition, in, sizeof(float) * (size_t)first);
+        std::memcpy(ring, in + first, sizeof(float) * (size_t)second);
+    }
+
+    mWritePosition = (mWritePosition + count) % mCapacity;
+    mFilled = mFilled + count < mCapacity ? mFilled + count : mCapacity;
+}
+
+void ReplayBuffer::Process(float* const* channels, const int& numChannels,
+                           const int& numSamples) {
+    if(mCapacity == 0 || numChannels == 0)
+        return;
+
+    if(!IsReplaying()) {
+        Capture(channels, numChannels, numSamples);
+        return;
+    }
+
+    const int replayChannels = numChannels < mNumChannels ? numChannels : mNumChannels;
+
+    for(int sample = 0; sample < numSamples; ++sample) {
+        if(mMix < mMixTarget)
+            mMix = mMix + mMixStep > mMixTarget ? mMixTarget : mMix + mMixStep;
+        else if(mMix > mMixTarget)
+            mMix = mMix - mMixStep < mMixTarget ? mMixTarget : mMix - mMixStep;
+
+        int readPosition = mPassageStart + mPassagePosition;
+        if(readPosition >= mCapacity)
+            readPosition -= mCapacity;
+
+        // at the loop point, the head comes in over the tail that would have followed
+        // on. the two are unrelated audio, so an equal-power fade keeps the level steady
+        const bool inSeam = mLooped && mPassagePosition < mSeamSamples;
+        float headGain = 1.0f, tailGain = 0.0f;
+        int tailPosition = 0;
+
+        if(inSeam) {
+            const float angle = 1.5707963f * ((float)mPassagePosition + 0.5f) / (float)mSeamSamples;
+            headGain = std::sin(angle);
+            tailGain = std::cos(angle);
+
+            tailPosition = readPosition + mLoopLength;
+            if(tailPosition >= mCapacity)
+                tailPosition -= mCapacity;
+        }
+
+        for(int channel = 0; channel < replayChannels; ++channel) {
+            const float* ring = mStorage.data() + (size_t)(channel * mCapacity);
+
+            float replayed = ring[readPosition];
+            if(inSeam)
+                replayed = replayed * headGain + ring[tailPosition] * tailGain;
+
+            channels[channel][sample] += mMix * (replayed - channels[channel][sample]);
+        }
+
+        if(++mPassagePosition >= mLoopLength) {
+            mPassagePosition = 0;
+            mLooped = true;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+// Declaration of the replay buffer, which keeps the last few seconds of dry input
+// so an exercise passage can be heard again (with the hidden band, then with the
+// guess) without needing the host's transport.
+//
+// Storage is allocated off the audio thread (when an editor first opens, and again
+// in prepareToPlay() if the sample rate or channel count has changed, so a host
+// preparing again for a transport change keeps the capture), and the capture is a
+// plain copy into the ring. Everything else runs on the audio thread, which owns the ring
+// outright, so the only thing shared with the message thread is the processor's
+// replay flag. While replaying, the passage loops and capture is frozen, so it
+// can be replayed as many times as needed.
+
+#pragma once
+#include <vector>
+
+class ReplayBuffer {
+ private:
+    // one ring per channel, packed end to end
+    std::vector<float> mStorage;
+
+    int mSampleRate {}, mNumChannels {}, mCapacity {};
+
+    // capture position, and how much of the ring holds audio so far
+    int mWritePosition {}, mFilled {};
+
+    // the passage being replayed, and how far through it we are
+    int mPassageStart {}, mPassageLength {}, mPassagePosition {};
+
+    // the loop is the passage less the seam: each pass after the first starts with the
+    // head faded in over the tail that carries on from the last pass
+    int mLoopLength {}, mSeamSamples {};
+    bool mLooped = false;
+
+    // 0 = live input, 1 = replay. both ends are crossfaded, and so is the loop point
+    float mMix {}, mMixTarget {}, mMixStep {};
+    int mFadeSamples = 1;
+
+    void Capture(const float* const* channels, const int& numChannels,
+                 const int& numSamples);
+
+    void StartPassage();
+
+ public:
+    // allocates, so never call this from the audio thread. does nothing if it's
+    // already prepared for this rate and channel count
+    void Prepare(const int& sampleRate, const int& numChannels);
+
+    void Reset();
+
+    // replays from the start of the captured passage, or goes back to the input
+    void SetReplaying(const bool& shouldReplay);
+    bool IsReplaying() const;
+
+    // captures the block, or replaces it with the passage while replaying
+    void Process(float* const* channels, const int& numChannels, const int& numSamples);
+
+    // bounds the memory per instance (about 3 MB of stereo at 48 kHz)
+    static constexpr double maximumSeconds = 8.0;
+
+    static constexpr double fadeTimeMs = 5.0;
+};
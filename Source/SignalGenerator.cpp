@@ -0,0 +1,199 @@
+// Implementation of the built-in test signal generator
+
+#include "SignalGenerator.h"
+#include <random>
+
+namespace {
+    // the same constants as RandomParameters::Random()
+    constexpr uint32_t lehmerIncrement = 0xe120fc15,
+                        lehmerMul1 = 0x4a39b70d,
+                        lehmerMul2 = 0x12fad5c9;
+
+    constexpr float pinkPoles[8] = { 0.99886f, 0.99332f, 0.96900f, 0.86650f,
+                                     0.55000f, -0.7616f, 0.0f, 0.0f },
+                    pinkGains[8] = { 0.0555179f, 0.0750759f, 0.1538520f, 0.3104856f,
+                                     0.5329522f, -0.0168980f, 0.115926f, 0.0f };
+
+    // Kellet's filter has roughly +20 dB of gain
+    constexpr float pinkScale = 0.11f;
+
+    // scale each source to roughly -18 dBFS RMS (measured)
+    constexpr float whiteGain = 0.217f, pinkGain = 0.644f, brownGain = 0.217f,
+                    sweepGain = 0.177f, programGain = 1.09f;
+
+    // brown noise is white noise through a one-pole at this frequency
+    constexpr double brownCornerHz = 10.0;
+
+    // how often the program level wanders somewhere new
+    constexpr double programStepSeconds = 0.15;
+}
+
+SignalGenerator::SignalGenerator() {
+    // seed each lane one step apart, from std::random_device like RandomParameters
+    // (instances a host creates together would share a system-time seed, and play
+    // identical noise), and wind them back a block so the first block starts at the
+    // first step
+    std::random_device device;
+    uint32_t seed = (uint32_t)device();
+
+    seed -= lehmerIncrement * (numLanes - 1);
+
+    for(auto& laneSeed : mSeeds) {
+        laneSeed = seed;
+        seed += lehmerIncrement;
+    }
+}
+
+void SignalGenerator::SetSampleRate(const int& sampleRate) {
+    this->mSampleRate = sampleRate;
+
+    const double highHz = sampleRate * 0.45 < sweepHighHz ? sampleRate * 0.45 : sweepHighHz;
+    mSweepRatio = pow(highHz / sweepLowHz, 1.0 / (sweepTimeSeconds * sampleRate));
+
+    mProgramLow.SetSampleRate(sampleRate);
+    mProgramLow.SetParameters(HighPass, 60.0, 0.707, 0.0);
+    mProgramHigh.SetSampleRate(sampleRate);
+    mProgramHigh.SetParameters(LowPass, highHz < 12000.0 ? highHz : 12000.0, 0.707, 0.0);
+
+    // the input is scaled so the output has the same variance as the white noise
+    mBrownPole = (float)exp(-2.0 * M_PI * brownCornerHz / sampleRate);
+    mBrownInput = sqrtf(1.0f - mBrownPole * mBrownPole);
+
+    // the level glides over a quarter of each step
+    mProgramSmoothing = (float)(1.0 - exp(-4.0 / (programStepSeconds * sampleRate)));
+
+    Reset();
+}
+
+void SignalGenerator::Reset() {
+    for(auto& state : mPinkState)
+        state = 0.0f;
+
+    mPreviousWhite = mBrownState = 0.0f;
+
+    mSweepPhase = 0.0;
+    mSweepFreq = sweepLowHz;
+
+    mProgramLevel = mProgramTarget = 0.5f;
+    mProgramCountdown = 0;
+}
+
+void SignalGenerator::GenerateWhite(float* out, const int& numSamples) {
+    for(int i = 0; i < numSamples; i += numLanes) {
+        for(int lane = 0; lane < numLanes; ++lane) {
+            mSeeds[lane] = (mSeeds[lane] + lehmerIncrement * numLanes) & 0xffffffff;
+
+            uint64_t tmp = mSeeds[lane] * lehmerMul1;
+            const uint32_t m1 = (uint32_t)((tmp >> 32) ^ tmp);
+            tmp = (uint64_t)m1 * lehmerMul2;
+
+            // reinterpret as signed to get a full-scale bipolar value
+            out[i + lane] = (float)(int)(uint32_t)((tmp >> 32) ^ tmp) * 4.656613e-10f;
+        }
+    }
+}
+
+void SignalGenerator::NextWhite(const int& count) {
+    for(int i = 0; i < mNumSpare; ++i)
+        mWhite[i] = mSpareWhite[i];
+
+    // rounded up to whole lanes, the values past count are kept for next time
+    const int needed = count > mNumSpare ? count - mNumSpare : 0,
+              generated = (needed + numLanes - 1) / numLanes * numLanes,
+              total = mNumSpare + generated;
+
+    GenerateWhite(mWhite + mNumSpare, generated);
+
+    mNumSpare = total - count;
+    for(int i = 0; i < mNumSpare; ++i)
+        mSpareWhite[i] = mWhite[count + i];
+}
+
+float SignalGenerator::NextPink(const float& white) {
+    // the sixth lane is Kellet's one-sample-delayed term, so it takes the previous input
+    alignas(32) float in[numLanes];
+
+    for(auto& lane : in)
+        lane = white;
+
+    in[6] = mPreviousWhite;
+    mPreviousWhite = white;
+
+    float sum = white * 0.5362f;
+
+    for(int lane = 0; lane < numLanes; ++lane) {
+        mPinkState[lane] = pinkPoles[lane] * mPinkState[lane] + in[lane] * pinkGains[lane];
+        sum += mPinkState[lane];
+    }
+
+    return sum * pinkScale;
+}
+
+void SignalGenerator::Generate(const Source& source, float* out, const int& numSamples) {
+    if(source == Input)
+        return;
+
+    for(int start = 0; start < numSamples; start += chunkSize) {
+        const int count = numSamples - start < chunkSize ? numSamples - start : chunkSize;
+        float* chunk = out + start;
+
+        NextWhite(count);
+
+        switch(source) {
+            case White:
+                for(int i = 0; i < count; ++i)
+                    chunk[i] = mWhite[i] * whiteGain;
+                break;
+
+            case Pink:
+                for(int i = 0; i < count; ++i)
+                    chunk[i] = NextPink(mWhite[i]) * pinkGain;
+                break;
+
+            case Brown:
+                // leaky integrator, so it can't drift off
+                for(int i = 0; i < count; ++i) {
+                    mBrownState = mBrownPole * mBrownState + mBrownInput * mWhite[i];
+                    chunk[i] = mBrownState * brownGain;
+                }
+                break;
+
+            case Sweep: {
+                const double highHz = sweepLowHz * pow(mSweepRatio, sweepTimeSeconds * mSampleRate);
+
+                for(int i = 0; i < count; ++i) {
+                    chunk[i] = (float)sin(mSweepPhase) * sweepGain;
+
+                    mSweepPhase += 2.0 * M_PI * mSweepFreq / mSampleRate;
+                    if(mSweepPhase > 2.0 * M_PI)
+                        mSweepPhase -= 2.0 * M_PI;
+
+                    // the phase carries on, so restarting the sweep doesn't click
+                    mSweepFreq *= mSweepRatio;
+                    if(mSweepFreq > highHz)
+                        mSweepFreq = sweepLowHz;
+                }
+                break;
+            }
+
+            case Program:
+                for(int i = 0; i < count; ++i) {
+                    if(--mProgramCountdown <= 0) {
+                        mProgramCountdown = (int)(programStepSeconds * mSampleRate);
+                        mProgramTarget = 0.25f + fabsf(mWhite[i]);
+                    }
+
+                    mProgramLevel += mProgramSmoothing * (mProgramTarget - mProgramLevel);
+
+                    const double band = mProgramHigh.Process(
+                        mProgramLow.Process((double)NextPink(mWhite[i])));
+
+                    chunk[i] = (float)band * mProgramLevel * programGain;
+                }
+                break;
+
+            case Input:
+                break;
+        }
+    }
+}
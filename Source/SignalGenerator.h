@@ -0,0 +1,79 @@
+// Declaration of the built-in test signal generator, mainly for the standalone
+// build, where there may be no input device routed in. Everything is generated
+// in blocks into fixed-size storage, so nothing allocates on the audio thread.
+//
+// White noise comes from a lane-wise version of the RandomParameters Lehmer
+// generator: each lane starts one step apart and advances by the lane count, so
+// the lanes produce the scalar generator's exact sequence, just several at once.
+// The pinking filter is a bank of one-pole filters fed by the same white sample,
+// so it runs as one packed operation per sample rather than seven serial ones.
+
+#pragma once
+#include "Filter.h"
+#include "RandomParameters.h"
+
+class SignalGenerator {
+ public:
+    // also the combo box IDs
+    enum Source {
+        Input = 1,
+        White,
+        Pink,
+        Brown,
+        Sweep,
+        Program
+    };
+
+ private:
+    static constexpr int numLanes = 8,
+                         chunkSize = 256;
+
+    // 32-bit seeds kept in 64-bit lanes, which the widening multiply wants anyway
+    alignas(32) uint64_t mSeeds[numLanes] {};
+
+    // white noise for the current chunk, which the other sources are built from.
+    // it's generated a whole step of the lanes at a time, so there's room for the
+    // values that run past the end of the chunk
+    alignas(32) float mWhite[chunkSize + numLanes] {};
+
+    // values generated but not used yet, which start the next chunk
+    float mSpareWhite[numLanes] {};
+    int mNumSpare {};
+
+    // pinking filter bank (Paul Kellet's refined method), the last lane is unused
+    alignas(32) float mPinkState[numLanes] {};
+    float mPreviousWhite {};
+
+    float mBrownState {}, mBrownPole {}, mBrownInput {};
+
+    double mSweepPhase {}, mSweepFreq {}, mSweepRatio {};
+
+    // program-like noise is band-limited pink noise with a wandering level
+    Filter mProgramLow, mProgramHigh;
+    float mProgramLevel {}, mProgramTarget {}, mProgramSmoothing {};
+    int mProgramCountdown {};
+
+    int mSampleRate {};
+
+    // writes numSamples (a multiple of the lane count) of white noise to out
+    void GenerateWhite(float* out, const int& numSamples);
+
+    // fills the start of mWhite with count values, spare ones first
+    void NextWhite(const int& count);
+
+    float NextPink(const float& white);
+
+ public:
+    SignalGenerator();
+
+    void SetSampleRate(const int& sampleRate);
+
+    void Reset();
+
+    // writes numSamples of the given source into out (does nothing for Input)
+    void Generate(const Source& source, float* out, const int& numSamples);
+
+    static constexpr double sweepTimeSeconds = 8.0,
+                            sweepLowHz = 20.0,
+                            sweepHighHz = 20000.0;
+};
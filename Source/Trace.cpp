@@ -0,0 +1,134 @@
+// Implementation of the trace rings and the Chrome trace JSON writer
+
+#include "Trace.h"
+#include "RealtimeCheck.h"
+
+#if RANDOMEQ_TRACE
+
+#include <fstream>
+#include <vector>
+
+namespace {
+    constexpr std::uint32_t maxThreads = 16;
+
+    Trace::Ring rings[maxThreads];
+    std::atomic<std::uint32_t> nextThreadId { 1 };
+
+    // gives the thread's ring back when it exits. only touched when claiming, so the
+    // thread_local registration stays out of the recording path
+    struct RingRelease {
+        Trace::Ring* ring = nullptr;
+
+        ~RingRelease() {
+            if(ring == nullptr)
+                return;
+
+            // anything recorded after this (from another thread_local's destructor)
+            // is dropped, rather than written into a ring someone else may claim
+            Trace::threadState = { nullptr, true };
+            ring->inUse.store(false, std::memory_order_release);
+        }
+    };
+
+    thread_local RingRelease ringRelease;
+
+    // reference points for converting ticks to microseconds when dumping
+    const std::uint64_t startTicks = Trace::Ticks();
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // a copy of one slot, taken while its thread may still be writing
+    struct Copy {
+        const char* name;
+        std::uint64_t start, end;
+        bool isCounter;
+    };
+}
+
+Trace::Ring* Trace::ClaimRing() {
+    for(Ring& ring : rings) {
+        bool inUse = false;
+
+        if(ring.inUse.load(std::memory_order_relaxed)
+           || !ring.inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+            continue;
+
+        ring.firstIndex.store(ring.writeIndex.load(std::memory_order_relaxed),
+                              std::memory_order_relaxed);
+        ring.threadId.store(nextThreadId.fetch_add(1), std::memory_order_release);
+
+        ringRelease.ring = &ring;
+        return &ring;
+    }
+
+    return nullptr;
+}
+
+bool Trace::WriteJson(const std::string& path) {
+    RT_ASSERT_NOT_AUDIO_THREAD("Trace::WriteJson() writes a file");
+
+    std::ofstream file(path);
+    if(!file)
+        return false;
+
+    const double elapsedUs = std::chrono::duration<double, std::micro>
+        (std::chrono::steady_clock::now() - startTime).count();
+    const double ticksToUs = elapsedUs / (double)(Ticks() - startTicks);
+
+    file.setf(std::ios::fixed);
+    file.precision(3);
+
+    file << "{\"traceEvents\":[";
+    bool first = true;
+
+    std::vector<Copy> copies(Ring::capacity);
+
+    for(const Ring& ring : rings) {
+        const std::uint32_t threadId = ring.threadId.load(std::memory_order_acquire);
+        if(threadId == 0)
+            continue;
+
+        const std::uint32_t oldest = ring.firstIndex.load(std::memory_order_relaxed);
+        const std::uint32_t end = ring.writeIndex.load(std::memory_order_acquire);
+        std::uint32_t begin = end > Ring::capacity ? end - Ring::capacity : 0;
+        begin = begin > oldest ? begin : oldest;
+
+        for(std::uint32_t i = begin; i < end; ++i) {
+            const Event& event = ring.events[i & (Ring::capacity - 1)];
+
+            copies[i - begin] = { event.name.load(std::memory_order_relaxed),
+                                  event.start.load(std::memory_order_relaxed),
+                                  event.end.load(std::memory_order_relaxed),
+                                  event.isCounter.load(std::memory_order_relaxed) };
+        }
+
+        // the thread kept going while we copied. the slot it's writing now (and any
+        // before it) held an older event, so those copies may be half old, half new
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const std::uint32_t written = ring.writeIndex.load(std::memory_order_relaxed);
+        const std::uint32_t valid = written >= Ring::capacity ? written - Ring::capacity + 1 : 0;
+
+        for(std::uint32_t i = begin > valid ? begin : valid; i < end; ++i) {
+            const Copy& event = copies[i - begin];
+
+            file << (first ? "" : ",")
+                 << "{\"name\":\"" << event.name << "\",\"ph\":\"" << (event.isCounter ? "C" : "X")
+                 << "\",\"pid\":1,\"tid\":" << threadId
+                 << ",\"ts\":" << (double)(event.start - startTicks) * ticksToUs;
+
+            if(event.isCounter) {
+                double value;
+                std::memcpy(&value, &event.end, sizeof(value));
+                file << ",\"args\":{\"value\":" << value << "}}";
+            } else {
+                file << ",\"dur\":" << (double)(event.end - event.start) * ticksToUs << "}";
+            }
+
+            first = false;
+        }
+    }
+
+    file << "]}\n";
+    return (bool)file;
+}
+
+#endif
@@ -0,0 +1,158 @@
+// Compile-time-optional trace scopes, for lining up audio blocks with editor
+// clicks, coefficient calculations and repaints when chasing dropouts.
+//
+// Build with RANDOMEQ_TRACE=1 (the CMake option of the same name) to enable them.
+// Each thread records into its own preallocated, lock-free ring of events, which
+// can be dumped as Chrome/Perfetto trace JSON at any time. Timestamps are raw CPU
+// ticks, converted to time only when dumping, so a scope is two counter reads and
+// a few stores, and the counter reads are nearly all of the cost. Counters
+// (TRACE_COUNTER) record a value over time in the same rings, and show up as graphs.
+// With tracing disabled, both macros expand to nothing.
+
+#pragma once
+
+#if RANDOMEQ_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+ #include <x86intrin.h>
+#endif
+
+namespace Trace {
+    // the fields are only ever stored and loaded relaxed, they're atomic so a dump
+    // can read a slot while it's being overwritten (and then throw it away)
+    struct Event {
+        std::atomic<const char*> name;
+        std::atomic<std::uint64_t> start;
+
+        // the end of a span, or the bits of a counter's value
+        std::atomic<std::uint64_t> end;
+        std::atomic<bool> isCounter;
+    };
+
+    // single-writer ring, only ever written by the thread that claimed it
+    struct Ring {
+        static constexpr std::uint32_t capacity = 1 << 13;
+
+        Event events[capacity];
+        std::atomic<std::uint32_t> writeIndex { 0 };
+
+        // held by a running thread. it's given back when the thread exits, so threads
+        // that come and go (like the exercise prefetch worker) don't use them all up
+        std::atomic<bool> inUse { false };
+
+        // set by each claim (0 if it's never been claimed). a dump only shows events
+        // from firstIndex on, so a thread that's gone isn't mixed in with the next one
+        std::atomic<std::uint32_t> threadId { 0 }, firstIndex { 0 };
+    };
+
+    inline std::uint64_t Ticks() {
+       #if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+        return __rdtsc();
+       #elif defined(__aarch64__)
+        std::uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+       #else
+        return (std::uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+       #endif
+    }
+
+    // claims one of the preallocated rings the first time a thread records
+    // (returns nullptr while they're all in use, and the events are dropped)
+    Ring* ClaimRing();
+
+    // constant-initialised, so it's a plain thread-local load rather than a call
+    // that checks whether it's been set up yet
+    struct ThreadState {
+        Ring* ring;
+        bool claimed;
+    };
+
+    inline thread_local ThreadState threadState { nullptr, false };
+
+    inline Ring* GetThreadRing() {
+        ThreadState& state = threadState;
+
+        if(__builtin_expect(!state.claimed, 0)) {
+            state.claimed = true;
+            state.ring = ClaimRing();
+        }
+
+        return state.ring;
+    }
+
+    // claims this thread's ring now, rather than in the middle of the first scope.
+    // the first touch of a thread_local can allocate (on macOS, say), so the audio
+    // thread should call this before anything real-time
+    inline void Prepare() {
+        GetThreadRing();
+    }
+
+    inline void Write(const char* name, const std::uint64_t& start, const std::uint64_t& end,
+                      const bool& isCounter) {
+        Ring* ring = GetThreadRing();
+        if(ring == nullptr)
+            return;
+
+        const std::uint32_t index = ring->writeIndex.load(std::memory_order_relaxed);
+
+        // anything that sees these stores will also see writeIndex at this index
+        // or later, which is how a dump tells a slot was overwritten under it
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Event& event = ring->events[index & (Ring::capacity - 1)];
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(start, std::memory_order_relaxed);
+        event.end.store(end, std::memory_order_relaxed);
+        event.isCounter.store(isCounter, std::memory_order_relaxed);
+
+        ring->writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    inline void Record(const char* name, const std::uint64_t& start, const std::uint64_t& end) {
+        Write(name, start, end, false);
+    }
+
+    inline void RecordCounter(const char* name, const double& value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        Write(name, Ticks(), bits, true);
+    }
+
+    class Scope {
+     private:
+        const char* mName;
+        std::uint64_t mStart;
+
+     public:
+        // the name must outlive the trace (i.e. a string literal)
+        explicit Scope(const char* name) : mName(name), mStart(Ticks()) {}
+        ~Scope() { Record(mName, mStart, Ticks()); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // writes every thread's recent events as Chrome trace JSON, returns false on failure
+    bool WriteJson(const std::string& path);
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) Trace::RecordCounter(name, (double)(value))
+#define TRACE_PREPARE() Trace::Prepare()
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_COUNTER(name, value)
+#define TRACE_PREPARE()
+
+#endif